@@ -0,0 +1,1474 @@
+/*
+    Benchmarks for cjson.h
+
+    Build and run from this directory:
+        gcc -O2 bench.c -o bench
+        ./bench            runs every benchmark
+        ./bench arena      runs only the named benchmark
+
+    Scanning kernels are picked at runtime; set CJSON_KERNEL to scalar,
+    sse2, avx2 or avx512 to pin one, or build with -DJSON_NO_SIMD to leave
+    only the scalar ones. Branch misses are read with perf_event_open on Linux;
+    where that is not permitted they print as -1.
+*/
+#define _POSIX_C_SOURCE 199309L
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** Count every trip to the heap made by the parser, and the bytes it holds.
+    Each block is prefixed with its size so frees can be accounted for. */
+static long bench_allocs = 0;
+static long bench_frees = 0;
+static size_t bench_live = 0;
+static size_t bench_peak = 0;
+
+#define BENCH_HEADER 16
+
+static void
+bench_account(size_t added, size_t removed)
+{
+    bench_live += added;
+    bench_live -= removed;
+    if (bench_live > bench_peak)
+        bench_peak = bench_live;
+}
+
+static void*
+bench_malloc(size_t size)
+{
+    bench_allocs++;
+    char *block = (char*) malloc(size + BENCH_HEADER);
+    *(size_t*) block = size;
+    bench_account(size, 0);
+    return block + BENCH_HEADER;
+}
+
+static void*
+bench_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return bench_malloc(size);
+    bench_allocs++;
+    char *block = (char*) ptr - BENCH_HEADER;
+    bench_account(size, *(size_t*) block);
+    block = (char*) realloc(block, size + BENCH_HEADER);
+    *(size_t*) block = size;
+    return block + BENCH_HEADER;
+}
+
+static void
+bench_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    bench_frees++;
+    char *block = (char*) ptr - BENCH_HEADER;
+    bench_account(0, *(size_t*) block);
+    free(block);
+}
+
+#define malloc(size) bench_malloc(size)
+#define realloc(ptr, size) bench_realloc(ptr, size)
+#define free(ptr) bench_free(ptr)
+#include "../cjson.h"
+#undef malloc
+#undef realloc
+#undef free
+
+/** Growable output buffer for generated documents */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} bench_buf;
+
+static void
+bench_buf_append(bench_buf *buf, const char *s)
+{
+    size_t n = strlen(s);
+    if (buf->length + n + 1 > buf->capacity) {
+        buf->capacity = (buf->length + n + 1) * 2;
+        buf->data = (char*) realloc(buf->data, buf->capacity);
+    }
+    memcpy(buf->data + buf->length, s, n + 1);
+    buf->length += n;
+}
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Array of mixed records, roughly 100 bytes each */
+static char*
+bench_gen_records(int n)
+{
+    bench_buf buf = {NULL, 0, 0};
+    char line[256];
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line),
+            "%s{\"id\": %d, \"name\": \"record %d\", \"score\": %d.%d, "
+            "\"active\": %s, \"tags\": [\"a\", \"b\"], \"parent\": null}",
+            i ? ", " : "", i, i, i % 1000, i % 7, i % 2 ? "true" : "false");
+        bench_buf_append(&buf, line);
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** The same records as bench_gen_records, pretty-printed with 4-space indentation */
+static char*
+bench_gen_pretty(int n)
+{
+    bench_buf buf = {NULL, 0, 0};
+    char line[512];
+    bench_buf_append(&buf, "[\n");
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line),
+            "    {\n        \"id\": %d,\n        \"name\": \"record %d\",\n"
+            "        \"score\": %d.%d,\n        \"active\": %s,\n"
+            "        \"tags\": [\n            \"a\",\n            \"b\"\n        ],\n"
+            "        \"parent\": null\n    }%s\n",
+            i, i, i % 1000, i % 7, i % 2 ? "true" : "false", i + 1 < n ? "," : "");
+        bench_buf_append(&buf, line);
+    }
+    bench_buf_append(&buf, "]\n");
+    return buf.data;
+}
+
+/** Array of n strings of len bytes each, base64-like text with an escape every 1KB */
+static char*
+bench_gen_strings(int n, int len)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *out = (char*) malloc((size_t) n * (len + 3) + 3);
+    size_t pos = 0;
+    out[pos++] = '[';
+    for (int i = 0; i < n; i++) {
+        if (i)
+            out[pos++] = ',';
+        out[pos++] = '"';
+        for (int k = 0; k < len; k++) {
+            if (k % 1024 == 1022) {
+                out[pos++] = '\\';
+                out[pos++] = '"';
+                k++;
+            } else {
+                out[pos++] = alphabet[(i + k * 7) & 63];
+            }
+        }
+        out[pos++] = '"';
+    }
+    out[pos++] = ']';
+    out[pos] = STR_END;
+    return out;
+}
+
+/** Messages mixing ASCII with two, three and four byte UTF-8 sequences */
+static char*
+bench_gen_text(int n)
+{
+    static const char *words[] = {"caf\xc3\xa9", "na\xc3\xafve", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+        "status", "\xf0\x9f\x98\x80", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "ok"};
+    bench_buf buf = {NULL, 0, 0};
+    char line[256];
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line), "%s{\"user\":\"%s\",\"text\":\"%s %s %s %s\"}",
+            i ? "," : "", words[i % 7], words[(i / 7) % 7], words[(i + 3) % 7],
+            words[(i / 3) % 7], words[(i + 5) % 7]);
+        bench_buf_append(&buf, line);
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** Array of records with fields filler fields each, "id" first, "name" midway and "ts" last */
+static char*
+bench_gen_wide(int n, int fields)
+{
+    bench_buf buf = {NULL, 0, 0};
+    char line[256];
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line), "%s{\"id\": %d", i ? ", " : "", i);
+        bench_buf_append(&buf, line);
+        for (int f = 0; f < fields; f++) {
+            if (f == fields / 2) {
+                snprintf(line, sizeof(line), ", \"name\": \"record %d\"", i);
+                bench_buf_append(&buf, line);
+            }
+            if (f % 4 == 0)
+                snprintf(line, sizeof(line), ", \"f%d\": {\"x\": [%d, %d.5], \"s\": \"v\\\"}\"}", f, f, i);
+            else if (f % 4 == 1)
+                snprintf(line, sizeof(line), ", \"f%d\": \"value %d of record %d\"", f, f, i);
+            else
+                snprintf(line, sizeof(line), ", \"f%d\": %s", f, f % 4 == 2 ? "12345.678" : "true");
+            bench_buf_append(&buf, line);
+        }
+        snprintf(line, sizeof(line), ", \"ts\": %d}", 1700000000 + i);
+        bench_buf_append(&buf, line);
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** Array of ingest records: id, a user object, five events with payloads, and metadata */
+static char*
+bench_gen_ingest(int n)
+{
+    bench_buf buf = {NULL, 0, 0};
+    char line[512];
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line),
+            "%s{\"id\": %d, \"user\": {\"name\": \"user %d\", \"email\": \"u%d@example.com\", "
+            "\"address\": {\"city\": \"Springfield\", \"zip\": \"%05d\", \"geo\": [12.5, -3.25]}}, "
+            "\"events\": [", i ? ", " : "", i, i, i, i % 100000);
+        bench_buf_append(&buf, line);
+        for (int e = 0; e < 5; e++) {
+            snprintf(line, sizeof(line),
+                "%s{\"ts\": %d, \"kind\": \"click\", \"payload\": {\"x\": %d, \"y\": %d, "
+                "\"target\": \"button-%d\", \"flags\": [true, false, null], \"ratio\": 0.%d}}",
+                e ? ", " : "", 1700000000 + i * 5 + e, e * 13, e * 7, e, i % 97);
+            bench_buf_append(&buf, line);
+        }
+        bench_buf_append(&buf, "], \"meta\": {\"source\": \"web\", \"version\": 3, \"tags\": [\"a\", \"b\", \"c\"]}}");
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** Telemetry-style events that are mostly true, false and null */
+static char*
+bench_gen_literals(int n)
+{
+    static const char *literals[] = {"true", "false", "null"};
+    bench_buf buf = {NULL, 0, 0};
+    char line[256];
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line),
+            "%s{\"ok\":%s,\"retry\":%s,\"err\":%s,\"flags\":[%s,%s,%s,%s]}",
+            i ? "," : "", literals[i % 2], literals[(i / 2) % 2], literals[2 - i % 3],
+            literals[i % 3], literals[(i + 1) % 3], literals[(i / 3) % 3], literals[i % 2]);
+        bench_buf_append(&buf, line);
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** GeoJSON-style coordinate pairs with 7 decimals, and a millisecond timestamp each */
+static char*
+bench_gen_coordinates(int n)
+{
+    bench_buf buf = {NULL, 0, 0};
+    char line[128];
+    unsigned int seed = 3;
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        double lon = -180.0 + (seed >> 8) % 3600000000u / 1e7;
+        seed = seed * 1103515245 + 12345;
+        double lat = -90.0 + (seed >> 8) % 1800000000u / 1e7;
+        snprintf(line, sizeof(line), "%s[%.7f,%.7f,%lld]", i ? "," : "", lon, lat,
+            1700000000000LL + i * 1013LL);
+        bench_buf_append(&buf, line);
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** Array of n numbers, a mix of small integers and short floats */
+static char*
+bench_gen_numbers(int n)
+{
+    bench_buf buf = {NULL, 0, 0};
+    char num[32];
+    bench_buf_append(&buf, "[");
+    for (int i = 0; i < n; i++) {
+        if (i % 2)
+            snprintf(num, sizeof(num), "%s%d", i ? "," : "", i % 1000);
+        else
+            snprintf(num, sizeof(num), "%s%d.%d", i ? "," : "", i % 100, i % 10);
+        bench_buf_append(&buf, num);
+    }
+    bench_buf_append(&buf, "]");
+    return buf.data;
+}
+
+/** Parse input with a fresh parser and report time and heap traffic */
+static void
+bench_parse(const char *label, char *input, bool use_arena)
+{
+    bench_allocs = bench_frees = 0;
+    double start = bench_now();
+    json_parser *p = use_arena ?
+        json_parser_create_arena(input) :
+        json_parser_create(input);
+    bool ok = json_parsearr(p, p->all_tokens->tokens[0]);
+    double parsed = bench_now();
+    int tokens = p->all_tokens->length;
+    json_parser_cleanup(p);
+    double done = bench_now();
+    printf("  %-8s ok=%d tokens=%d allocs=%ld frees=%ld parse=%.1fms cleanup=%.1fms\n",
+        label, ok, tokens, bench_allocs, bench_frees,
+        (parsed - start) * 1e3, (done - parsed) * 1e3);
+}
+
+static void
+bench_arena(void)
+{
+    char *input = bench_gen_records(200000);
+    printf("arena: %zu bytes of records\n", strlen(input));
+    bench_parse("heap", input, false);
+    bench_parse("arena", input, true);
+    free(input);
+}
+
+static long
+bench_tree_walk(json_jsontoken *t)
+{
+    long sum = t->type == JSON_STR ? t->end_in - t->start_in : 0;
+    for (int i = 0; i < t->children->length; i++)
+        sum += bench_tree_walk(t->children->tokens[i]);
+    return sum;
+}
+
+/** Look up the "id" key of every record: trees chase child pointers,
+    the tape hops over each key's subtree by index */
+static long
+bench_tree_ids(json_parser *p, json_jsontoken *arr)
+{
+    long sum = 0;
+    for (int i = 0; i < arr->children->length; i++) {
+        json_jsontoken *rec = arr->children->tokens[i];
+        for (int k = 0; k < rec->children->length; k++) {
+            json_jsontoken *key = rec->children->tokens[k];
+            if (key->end_in - key->start_in == 2 &&
+                memcmp(p->input + key->start_in, "id", 2) == 0)
+                sum += key->children->tokens[0]->end_in;
+        }
+    }
+    return sum;
+}
+
+static long
+bench_tape_ids(json_parser *p, int arr)
+{
+    json_tape *tape = p->tape;
+    long sum = 0;
+    for (int rec = json_tape_child(tape, arr); rec != -1; rec = json_tape_sibling(tape, arr, rec)) {
+        for (int key = json_tape_child(tape, rec); key != -1; key = json_tape_sibling(tape, rec, key)) {
+            json_tape_entry *e = &tape->entries[key];
+            if (e->length == 2 &&
+                memcmp(p->input + e->start_in, "id", 2) == 0)
+                sum += json_tape_end(&tape->entries[key + 1]);
+        }
+    }
+    return sum;
+}
+
+static void
+bench_tape(void)
+{
+    char *input = bench_gen_records(200000);
+    json_parser *p = json_parser_create(input);
+    json_parser_enable_tape(p);
+    json_parsearr(p, p->all_tokens->tokens[0]);
+    json_jsontoken *arr = p->all_tokens->tokens[1];
+    int rounds = 10;
+    long sum = 0;
+    printf("tape: %d tokens, %d rounds\n", p->tape->length, rounds);
+
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        sum += bench_tree_walk(arr);
+    double tree_walk = bench_now() - start;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < p->tape->length; i++)
+            if (json_tape_type(&p->tape->entries[i]) == JSON_STR)
+                sum -= p->tape->entries[i].length;
+    double tape_walk = bench_now() - start;
+    printf("  all strings  tree=%.1fms tape=%.1fms (check %ld)\n",
+        tree_walk * 1e3, tape_walk * 1e3, sum);
+
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        sum += bench_tree_ids(p, arr);
+    double tree_ids = bench_now() - start;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        sum -= bench_tape_ids(p, 1);
+    double tape_ids = bench_now() - start;
+    printf("  ids by key   tree=%.1fms tape=%.1fms (check %ld)\n",
+        tree_ids * 1e3, tape_ids * 1e3, sum);
+    json_parser_cleanup(p);
+    free(input);
+}
+
+static void
+bench_into(void)
+{
+    char *input = bench_gen_records(10);
+    json_tape_entry entries[256];
+    int rounds = 200000;
+    int count = 0;
+    printf("into: %zu byte message, %d rounds\n", strlen(input), rounds);
+
+    bench_allocs = 0;
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++) {
+        json_parser *p = json_parser_create(input);
+        json_parsearr(p, p->all_tokens->tokens[0]);
+        json_parser_cleanup(p);
+    }
+    double tree = bench_now() - start;
+    printf("  tree  allocs/msg=%ld %.0fns/msg\n",
+        bench_allocs / rounds, tree / rounds * 1e9);
+
+    bench_allocs = 0;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        json_parse_into(input, entries, 256, &count);
+    double into = bench_now() - start;
+    printf("  into  allocs/msg=%ld %.0fns/msg (%d entries)\n",
+        bench_allocs / rounds, into / rounds * 1e9, count);
+    free(input);
+}
+
+static void
+bench_reset(void)
+{
+    char *input = bench_gen_records(10);
+    int rounds = 200000;
+    printf("reset: %zu byte messages, %d rounds\n", strlen(input), rounds);
+
+    bench_allocs = 0;
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++) {
+        json_parser *p = json_parser_create(input);
+        json_parsearr(p, p->all_tokens->tokens[0]);
+        json_parser_cleanup(p);
+    }
+    double fresh = bench_now() - start;
+    printf("  create/cleanup  allocs/msg=%.2f %.0fns/msg\n",
+        (double) bench_allocs / rounds, fresh / rounds * 1e9);
+
+    for (int use_arena = 0; use_arena < 2; use_arena++) {
+        json_parser *p = use_arena ?
+            json_parser_create_arena(input) :
+            json_parser_create(input);
+        bench_allocs = 0;
+        start = bench_now();
+        for (int r = 0; r < rounds; r++) {
+            json_parser_reset(p, input);
+            json_parsearr(p, p->all_tokens->tokens[0]);
+        }
+        double reused = bench_now() - start;
+        printf("  reset %-9s allocs/msg=%.2f %.0fns/msg\n", use_arena ? "arena" : "heap",
+            (double) bench_allocs / rounds, reused / rounds * 1e9);
+        json_parser_cleanup(p);
+    }
+    free(input);
+}
+
+static double
+bench_tree_sum(json_parser *p, json_jsontoken *t)
+{
+    double sum = 0;
+    if (t->type == JSON_INT || t->type == JSON_FLO)
+        sum += strtod(p->input + t->start_in, NULL);
+    for (int i = 0; i < t->children->length; i++)
+        sum += bench_tree_sum(p, t->children->tokens[i]);
+    return sum;
+}
+
+static void
+bench_columns(void)
+{
+    char *input = bench_gen_records(200000);
+    json_parser *p = json_parser_create(input);
+    json_parser_enable_columns(p);
+    json_parsearr(p, p->all_tokens->tokens[0]);
+    json_jsontoken *arr = p->all_tokens->tokens[1];
+    json_columns *c = p->columns;
+    int rounds = 10;
+    printf("columns: %d tokens, %d rounds\n", c->length, rounds);
+
+    long strings = 0;
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        strings += bench_tree_walk(arr);
+    double tree = bench_now() - start;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = json_columns_find(c, JSON_STR, 0); i != -1; i = json_columns_find(c, JSON_STR, i + 1))
+            strings -= c->end_in[i] - c->start_in[i];
+    double cols = bench_now() - start;
+    printf("  find strings  tree=%.1fms columns=%.1fms (check %ld)\n",
+        tree * 1e3, cols * 1e3, strings);
+
+    int count = 0;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        count += json_columns_count(c, JSON_STR);
+    printf("  count strings columns=%.1fms (%d per round)\n",
+        (bench_now() - start) * 1e3, count / rounds);
+
+    double sum = 0;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        sum += bench_tree_sum(p, arr);
+    tree = bench_now() - start;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < c->length; i++)
+            if (c->types[i] == JSON_INT || c->types[i] == JSON_FLO)
+                sum -= strtod(input + c->start_in[i], NULL);
+    cols = bench_now() - start;
+    printf("  sum numbers   tree=%.1fms columns=%.1fms (check %.0f)\n",
+        tree * 1e3, cols * 1e3, sum);
+    json_parser_cleanup(p);
+    free(input);
+}
+
+static void
+bench_presize_run(const char *label, char *input, bool use_arena, bool presize)
+{
+    /** Report the second of two runs: the first pays for glibc
+        consolidating whatever the previous case freed */
+    for (int round = 0; round < 2; round++) {
+        bench_allocs = 0;
+        bench_live = bench_peak = 0;
+        double start = bench_now();
+        json_parser *p = use_arena ?
+            json_parser_create_arena(input) :
+            json_parser_create(input);
+        if (presize)
+            json_parser_presize(p);
+        double counted = bench_now();
+        json_parsearr(p, p->all_tokens->tokens[0]);
+        double done = bench_now();
+        if (round == 1)
+            printf("  %-16s allocs=%ld peak=%.1fMB presize=%.1fms total=%.1fms\n",
+                label, bench_allocs, bench_peak / 1e6,
+                (counted - start) * 1e3, (done - start) * 1e3);
+        json_parser_cleanup(p);
+    }
+}
+
+static void
+bench_presize(void)
+{
+    char *input = bench_gen_numbers(1000000);
+    printf("presize: array of 1M numbers\n");
+    bench_presize_run("heap doubling", input, false, false);
+    bench_presize_run("heap presized", input, false, true);
+    bench_presize_run("arena doubling", input, true, false);
+    bench_presize_run("arena presized", input, true, true);
+    free(input);
+    input = bench_gen_records(200000);
+    printf("presize: 200K records\n");
+    bench_presize_run("heap doubling", input, false, false);
+    bench_presize_run("heap presized", input, false, true);
+    free(input);
+}
+
+/** Bytes held per token by each representation, excluding the input */
+static void
+bench_memory(void)
+{
+    char *input = bench_gen_numbers(1000000);
+    size_t input_len = strlen(input);
+    printf("memory: %zu bytes of numbers\n", input_len);
+    printf("  layout: json_jsontoken=%zu json_jsontoken_list=%zu json_tape_entry=%zu\n",
+        sizeof(json_jsontoken), sizeof(json_jsontoken_list), sizeof(json_tape_entry));
+
+    for (int mode = 0; mode < 3; mode++) {
+        const char *label[] = {"tree", "arena", "tree+tape"};
+        bench_live = bench_peak = 0;
+        json_parser *p = mode == 1 ?
+            json_parser_create_arena(input) :
+            json_parser_create(input);
+        if (mode == 2)
+            json_parser_enable_tape(p);
+        json_parsearr(p, p->all_tokens->tokens[0]);
+        int tokens = p->all_tokens->length;
+        printf("  %-10s %.1f bytes/token, %.2fx input\n", label[mode],
+            (double) bench_live / tokens, (double) bench_live / input_len);
+        json_parser_cleanup(p);
+    }
+
+    int count = 0;
+    json_parse_into(input, NULL, 0, &count);
+    json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+    json_parse_into(input, entries, count, &count);
+    size_t bytes = sizeof(json_tape_entry) * count;
+    printf("  %-10s %.1f bytes/token, %.2fx input\n", "into",
+        (double) bytes / count, (double) bytes / input_len);
+    free(entries);
+    free(input);
+}
+
+/** Scan every whitespace run in input one byte at a time */
+static long
+bench_skip_scalar(const char *input)
+{
+    long sum = 0;
+    for (int pos = 0; input[pos] != STR_END; pos++) {
+        while (json_iswhitespace(input[pos]))
+            pos++;
+        sum += pos;
+    }
+    return sum;
+}
+
+static long
+bench_skip_vector(const char *input)
+{
+    long sum = 0;
+    int end = (int) strlen(input);
+    for (int pos = 0; input[pos] != STR_END; pos++) {
+        pos = json_skipws(input, pos, end);
+        sum += pos;
+    }
+    return sum;
+}
+
+/** Whitespace-heavy pretty-printed input against the same records minified */
+static void
+bench_whitespace(void)
+{
+    int records = 100000;
+    int rounds = 5;
+    char *inputs[2] = {bench_gen_records(records), bench_gen_pretty(records)};
+    const char *labels[2] = {"minified", "pretty"};
+    printf("whitespace: %d records, %d rounds\n", records, rounds);
+
+    for (int i = 0; i < 2; i++) {
+        size_t len = strlen(inputs[i]);
+        int count = 0;
+        json_parse_into(inputs[i], NULL, 0, &count);
+        json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+        double start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            json_parse_into(inputs[i], entries, count, &count);
+        double elapsed = (bench_now() - start) / rounds;
+        printf("  %-8s %zu bytes %.1fms %.0fMB/s\n", labels[i], len,
+            elapsed * 1e3, len / elapsed / 1e6);
+        free(entries);
+    }
+
+    double start = bench_now();
+    long sum = 0;
+    for (int r = 0; r < rounds; r++)
+        sum += bench_skip_scalar(inputs[1]);
+    double scalar = bench_now() - start;
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        sum -= bench_skip_vector(inputs[1]);
+    double vector = bench_now() - start;
+    printf("  skip runs scalar=%.1fms json_skipws=%.1fms (check %ld)\n",
+        scalar * 1e3, vector * 1e3, sum);
+    free(inputs[0]);
+    free(inputs[1]);
+}
+
+/** Long string values, where parse time is all spent finding the closing quote */
+static void
+bench_strings(void)
+{
+    int sizes[] = {64, 4096, 65536};
+    int rounds = 10;
+    for (int i = 0; i < 3; i++) {
+        char *input = bench_gen_strings((1 << 24) / sizes[i], sizes[i]);
+        size_t len = strlen(input);
+        int count = 0;
+        json_parse_into(input, NULL, 0, &count);
+        json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+        double start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            json_parse_into(input, entries, count, &count);
+        double elapsed = (bench_now() - start) / rounds;
+        printf("strings: %6d bytes each, %zu bytes %.1fms %.0fMB/s\n", sizes[i], len,
+            elapsed * 1e3, len / elapsed / 1e6);
+        free(entries);
+        free(input);
+    }
+}
+
+/** Reference engine against the structural index engine on the same parser setup */
+static void
+bench_indexed(void)
+{
+    int rounds = 5;
+    char *inputs[3] = {bench_gen_records(100000), bench_gen_pretty(100000),
+        bench_gen_strings(4096, 4096)};
+    const char *labels[3] = {"records", "pretty", "strings"};
+    for (int i = 0; i < 3; i++) {
+        size_t len = strlen(inputs[i]);
+        json_parser *p = json_parser_create_arena(inputs[i]);
+        json_parser_enable_tape(p);
+        double start = bench_now();
+        for (int r = 0; r < rounds; r++) {
+            json_parser_reset(p, inputs[i]);
+            json_parsevalue(p, p->all_tokens->tokens[0]);
+        }
+        double reference = (bench_now() - start) / rounds;
+        start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            json_parser_structurals(p);
+        double stage1 = (bench_now() - start) / rounds;
+        start = bench_now();
+        for (int r = 0; r < rounds; r++) {
+            json_parser_reset(p, inputs[i]);
+            json_parse_indexed(p, p->all_tokens->tokens[0]);
+        }
+        double indexed = (bench_now() - start) / rounds;
+        printf("indexed: %-8s %zu bytes reference=%.0fMB/s structurals=%.0fMB/s indexed=%.0fMB/s\n",
+            labels[i], len, len / reference / 1e6, len / stage1 / 1e6, len / indexed / 1e6);
+        json_parser_cleanup(p);
+        free(inputs[i]);
+    }
+}
+
+/** Opens a branch-miss counter for this thread, or returns -1 */
+static int
+bench_branch_counter(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static long long
+bench_branch_misses(int fd)
+{
+    long long count = -1;
+#ifdef __linux__
+    if (fd >= 0 && read(fd, &count, sizeof(count)) != sizeof(count))
+        count = -1;
+#endif
+    return count;
+}
+
+/** The switch and if/else ladder classification the parser ran before json_char_class */
+static __attribute__((noinline)) int
+bench_ladder_ws(char c)
+{
+    switch (c) {
+        case 0x20:
+        case 0x0c:
+        case 0x0a:
+        case 0x0d:
+        case 0x09:
+        case 0x0b:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static __attribute__((noinline)) int
+bench_table_ws(char c)
+{
+    return json_iswhitespace(c);
+}
+
+static __attribute__((noinline)) int
+bench_ladder_kind(char c)
+{
+    if (c == '-' || (c >= '0' && c <= '9'))
+        return JSON_CLASS_NUM;
+    else if (c == '\"')
+        return JSON_CLASS_STR;
+    else if (c == 'n')
+        return JSON_CLASS_NULL;
+    else if (c == 't' || c == 'f')
+        return JSON_CLASS_BOOL;
+    else if (c == '{')
+        return JSON_CLASS_OBJ;
+    else if (c == '[')
+        return JSON_CLASS_ARR;
+    return JSON_CLASS_INVALID;
+}
+
+static __attribute__((noinline)) int
+bench_table_kind(char c)
+{
+    return JSON_CLASS(c) & JSON_CLASS_VALUE;
+}
+
+static void
+bench_classify_run(const char *label, int (*classify)(char), const char *input, size_t len)
+{
+    int fd = bench_branch_counter();
+    long long misses = bench_branch_misses(fd);
+    double start = bench_now();
+    long sum = 0;
+    for (size_t i = 0; i < len; i++)
+        sum += classify(input[i]);
+    double elapsed = bench_now() - start;
+    long long after = bench_branch_misses(fd);
+    if (fd >= 0)
+        close(fd);
+    printf("  %-12s %.2fns/byte branch-misses/KB=%.1f (check %ld)\n", label,
+        elapsed / len * 1e9, misses < 0 ? -1.0 : (after - misses) * 1024.0 / len, sum);
+}
+
+/** Per-byte classification: whitespace over pretty-printed input and
+    value dispatch over a random stream of value-starting bytes */
+static void
+bench_classify(void)
+{
+    char *pretty = bench_gen_pretty(50000);
+    size_t len = strlen(pretty);
+    printf("classify: whitespace over %zu bytes of pretty records\n", len);
+    bench_classify_run("switch", bench_ladder_ws, pretty, len);
+    bench_classify_run("table", bench_table_ws, pretty, len);
+    free(pretty);
+
+    const char starts[] = "\"\"\"\"0123456789-ntf{[";
+    size_t n = 1 << 24;
+    char *values = (char*) malloc(n);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = starts[(seed >> 16) % (sizeof(starts) - 1)];
+    }
+    printf("classify: value dispatch over %zu random value starts\n", n);
+    bench_classify_run("if/else", bench_ladder_kind, values, n);
+    bench_classify_run("table", bench_table_kind, values, n);
+    free(values);
+}
+
+/** Every kernel level the CPU supports, on the same inputs */
+static void
+bench_kernels(void)
+{
+    int rounds = 5;
+    char *pretty = bench_gen_pretty(100000);
+    char *strings = bench_gen_strings(4096, 4096);
+    size_t pretty_len = strlen(pretty), strings_len = strlen(strings);
+    json_kernel selected = json_kernel_active();
+    printf("kernels: %zu bytes pretty, %zu bytes strings, default %s\n",
+        pretty_len, strings_len, json_kernel_name(selected));
+    for (int k = JSON_KERNEL_SCALAR; k <= JSON_KERNEL_AVX512; k++) {
+        if (!json_kernel_select((json_kernel) k))
+            continue;
+        int count = 0;
+        json_parse_into(pretty, NULL, 0, &count);
+        json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+        double start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            json_parse_into(pretty, entries, count, &count);
+        double ws = (bench_now() - start) / rounds;
+        free(entries);
+
+        json_parse_into(strings, NULL, 0, &count);
+        entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+        start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            json_parse_into(strings, entries, count, &count);
+        double str = (bench_now() - start) / rounds;
+        free(entries);
+
+        json_parser *p = json_parser_create(pretty);
+        start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            json_parser_structurals(p);
+        double index = (bench_now() - start) / rounds;
+        json_parser_cleanup(p);
+        printf("  %-7s pretty=%.0fMB/s strings=%.0fMB/s structurals=%.0fMB/s\n",
+            json_kernel_name((json_kernel) k), pretty_len / ws / 1e6,
+            strings_len / str / 1e6, pretty_len / index / 1e6);
+    }
+    json_kernel_select(selected);
+    free(pretty);
+    free(strings);
+}
+
+/** The byte loop json_parsebool and json_parsenull ran before json_match4 */
+static __attribute__((noinline)) int
+bench_match_bytes(const char *at, const char *word)
+{
+    for (int i = 0; i < 4; i++)
+        if (at[i] != word[i])
+            return 0;
+    return 1;
+}
+
+static __attribute__((noinline)) int
+bench_match_word(const char *at, const char *word)
+{
+    /** Every literal the loop below reaches spans at least four bytes */
+    return json_match4(at, 4, word);
+}
+
+static void
+bench_literals(void)
+{
+    char *input = bench_gen_literals(200000);
+    size_t len = strlen(input);
+    int rounds = 5;
+    int count = 0;
+    json_parse_into(input, NULL, 0, &count);
+    json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++)
+        json_parse_into(input, entries, count, &count);
+    double elapsed = (bench_now() - start) / rounds;
+    long literals = 0;
+    for (int i = 0; i < count; i++) {
+        json_jsontoken_type type = json_tape_type(&entries[i]);
+        literals += type == JSON_BOO || type == JSON_NUL;
+    }
+    printf("literals: %zu bytes, %ld literals, %.1fms %.0fMB/s\n",
+        len, literals, elapsed * 1e3, len / elapsed / 1e6);
+
+    int (*matchers[2])(const char*, const char*) = {bench_match_bytes, bench_match_word};
+    const char *labels[2] = {"bytes", "json_match4"};
+    for (int m = 0; m < 2; m++) {
+        long matched = 0;
+        start = bench_now();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < count; i++) {
+                const char *at = input + entries[i].start_in;
+                if (*at == 't')
+                    matched += matchers[m](at, "true");
+                else if (*at == 'f')
+                    matched += matchers[m](at + 1, "alse");
+                else if (*at == 'n')
+                    matched += matchers[m](at, "null");
+            }
+        }
+        elapsed = (bench_now() - start) / rounds;
+        printf("  %-12s %.2fns/literal (%ld matched)\n", labels[m],
+            elapsed / literals * 1e9, matched / rounds);
+    }
+    free(entries);
+    free(input);
+}
+
+/** Converting every number token: libc against the json_parse_* accessors */
+static void
+bench_convert(void)
+{
+    char *input = bench_gen_coordinates(500000);
+    int count = 0;
+    json_parse_into(input, NULL, 0, &count);
+    json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+    json_parse_into(input, entries, count, &count);
+    int rounds = 5;
+    long floats = 0, ints = 0;
+    for (int i = 0; i < count; i++) {
+        floats += json_tape_type(&entries[i]) == JSON_FLO;
+        ints += json_tape_type(&entries[i]) == JSON_INT;
+    }
+    printf("convert: %ld coordinates, %ld timestamps\n", floats, ints);
+
+    char scratch[64];
+    for (int mode = 0; mode < 2; mode++) {
+        double fsum = 0;
+        long long isum = 0;
+        double start = bench_now();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < count; i++) {
+                const char *at = input + entries[i].start_in;
+                int length = (int) entries[i].length;
+                json_jsontoken_type type = json_tape_type(&entries[i]);
+                if (mode == 0 && type == JSON_FLO) {
+                    /** strtod needs a terminated copy, as consumers do today */
+                    memcpy(scratch, at, length);
+                    scratch[length] = STR_END;
+                    fsum += strtod(scratch, NULL);
+                } else if (mode == 0 && type == JSON_INT) {
+                    memcpy(scratch, at, length);
+                    scratch[length] = STR_END;
+                    isum += strtoll(scratch, NULL, 10);
+                } else if (type == JSON_FLO) {
+                    double d;
+                    json_parse_double(at, length, &d);
+                    fsum += d;
+                } else if (type == JSON_INT) {
+                    int64_t v;
+                    json_parse_int64(at, length, &v);
+                    isum += v;
+                }
+            }
+        }
+        double elapsed = (bench_now() - start) / rounds;
+        printf("  %-10s %.1fms %.1fns/number (check %.3f %lld)\n",
+            mode == 0 ? "strtod" : "json_parse", elapsed * 1e3,
+            elapsed / (floats + ints) * 1e9, fsum, isum);
+    }
+    free(entries);
+    free(input);
+}
+
+/** The byte loop consumers decoded strings with before json_unescape */
+static __attribute__((noinline)) int
+bench_unescape_bytes(const char *at, int length, char *out)
+{
+    int o = 0;
+    for (int i = 0; i < length; i++) {
+        if (at[i] != '\\') {
+            out[o++] = at[i];
+            continue;
+        }
+        char c = at[++i];
+        out[o++] = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' :
+            c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+    }
+    out[o] = STR_END;
+    return o;
+}
+
+/** Decoding every string token: a byte loop against json_unescape */
+static void
+bench_unescape(void)
+{
+    int sizes[3] = {16, 256, 4096};
+    printf("unescape: 16MB of strings, escape every 1KB\n");
+    for (int s = 0; s < 3; s++) {
+        char *input = bench_gen_strings((1 << 24) / sizes[s], sizes[s]);
+        int count = 0;
+        json_parse_into(input, NULL, 0, &count);
+        json_tape_entry *entries = (json_tape_entry*) malloc(sizeof(json_tape_entry) * count);
+        json_parse_into(input, entries, count, &count);
+        char *out = (char*) malloc(sizes[s] + 1);
+        int rounds = 5;
+        for (int mode = 0; mode < 2; mode++) {
+            long total = 0;
+            double start = bench_now();
+            for (int r = 0; r < rounds; r++) {
+                for (int i = 0; i < count; i++) {
+                    if (json_tape_type(&entries[i]) != JSON_STR)
+                        continue;
+                    const char *at = input + entries[i].start_in;
+                    int length = (int) entries[i].length;
+                    total += mode == 0 ?
+                        bench_unescape_bytes(at, length, out) :
+                        json_unescape(at, length, out, sizes[s] + 1);
+                }
+            }
+            double elapsed = (bench_now() - start) / rounds;
+            printf("  %5dB %-14s %.1fms %.0fMB/s\n", sizes[s],
+                mode == 0 ? "bytes" : "json_unescape", elapsed * 1e3,
+                total / rounds / elapsed / 1e6);
+        }
+        free(out);
+        free(entries);
+        free(input);
+    }
+}
+
+/** Parse throughput with and without UTF-8 checking, on both engines */
+static void
+bench_utf8(void)
+{
+    int rounds = 5;
+    char *inputs[3] = {bench_gen_records(100000), bench_gen_strings(4096, 4096),
+        bench_gen_text(200000)};
+    const char *labels[3] = {"records", "strings", "text"};
+    for (int i = 0; i < 3; i++) {
+        size_t len = strlen(inputs[i]);
+        json_parser *p = json_parser_create_arena(inputs[i]);
+        json_parser_enable_tape(p);
+        /** Warm the arena and tape so the first mode timed does not grow them */
+        json_parsevalue(p, p->all_tokens->tokens[0]);
+        double elapsed[4];
+        for (int mode = 0; mode < 4; mode++) {
+            p->utf8 = mode % 2;
+            double start = bench_now();
+            for (int r = 0; r < rounds; r++) {
+                json_parser_reset(p, inputs[i]);
+                if (mode < 2)
+                    json_parsevalue(p, p->all_tokens->tokens[0]);
+                else
+                    json_parse_indexed(p, p->all_tokens->tokens[0]);
+            }
+            elapsed[mode] = (bench_now() - start) / rounds;
+        }
+        printf("utf8: %-8s %zu bytes reference %.0f/%.0fMB/s indexed %.0f/%.0fMB/s (off/on)\n",
+            labels[i], len, len / elapsed[0] / 1e6, len / elapsed[1] / 1e6,
+            len / elapsed[2] / 1e6, len / elapsed[3] / 1e6);
+        json_parser_cleanup(p);
+        free(inputs[i]);
+    }
+}
+
+/** The children loop callers wrote before json_obj_get */
+static __attribute__((noinline)) json_jsontoken*
+bench_obj_scan(json_parser *p, json_jsontoken *obj, const char *key, int length)
+{
+    for (int i = 0; i < obj->children->length; i++) {
+        json_jsontoken *k = obj->children->tokens[i];
+        if (k->end_in - k->start_in == length &&
+            memcmp(p->input + k->start_in, key, length) == 0)
+            return k->children->tokens[0];
+    }
+    return NULL;
+}
+
+/** Looking up every key of one wide object: a children scan against json_obj_get */
+static void
+bench_objects(void)
+{
+    int widths[4] = {8, 64, 512, 4096};
+    for (int w = 0; w < 4; w++) {
+        int width = widths[w];
+        bench_buf buf = {NULL, 0, 0};
+        char line[64];
+        bench_buf_append(&buf, "{");
+        for (int i = 0; i < width; i++) {
+            snprintf(line, sizeof(line), "%s\"field_%d\":%d", i ? "," : "", i * 7919 % width, i);
+            bench_buf_append(&buf, line);
+        }
+        bench_buf_append(&buf, "}");
+        json_parser *p = json_parser_create(buf.data);
+        json_parsevalue(p, p->all_tokens->tokens[0]);
+        json_jsontoken *obj = p->all_tokens->tokens[1];
+        char (*keys)[16] = (char(*)[16]) malloc(16 * width);
+        int *lengths = (int*) malloc(sizeof(int) * width);
+        for (int i = 0; i < width; i++)
+            lengths[i] = snprintf(keys[i], sizeof(keys[i]), "field_%d", i * 31 % width);
+        int lookups = 1 << 20;
+        double elapsed[2];
+        long found = 0;
+        for (int mode = 0; mode < 2; mode++) {
+            /** Every run starts without an index, so json_obj_get pays for building it */
+            json_parser_obj_indexes_release(p);
+            double start = bench_now();
+            for (int i = 0; i < lookups; i++) {
+                int k = i & (width - 1);
+                json_jsontoken *value = mode == 0 ?
+                    bench_obj_scan(p, obj, keys[k], lengths[k]) :
+                    json_obj_get(p, obj, keys[k], lengths[k]);
+                found += value != NULL;
+            }
+            elapsed[mode] = bench_now() - start;
+        }
+        free(keys);
+        free(lengths);
+        printf("objects: %4d keys scan=%.1fns get=%.1fns per lookup (%ld found)\n", width,
+            elapsed[0] / lookups * 1e9, elapsed[1] / lookups * 1e9, found);
+        json_parser_cleanup(p);
+        free(buf.data);
+    }
+}
+
+/** "/tags/1" of one record, walked by hand as callers did */
+static __attribute__((noinline)) json_jsontoken*
+bench_pointer_walk(json_parser *p, json_jsontoken *record)
+{
+    for (int i = 0; i < record->children->length; i++) {
+        json_jsontoken *k = record->children->tokens[i];
+        if (k->end_in - k->start_in == 4 && memcmp(p->input + k->start_in, "tags", 4) == 0) {
+            json_jsontoken *tags = k->children->tokens[0];
+            return tags->children->length > 1 ? tags->children->tokens[1] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/** Resolving one path in every record: by hand, from text, and compiled */
+static void
+bench_pointer(void)
+{
+    char *input = bench_gen_records(100000);
+    json_parser *p = json_parser_create_arena(input);
+    json_parsevalue(p, p->all_tokens->tokens[0]);
+    json_jsontoken *records = p->all_tokens->tokens[1];
+    json_pointer *compiled = json_pointer_compile("/tags/1");
+    const char *labels[3] = {"by hand", "json_pointer_get", "compiled"};
+    for (int mode = 0; mode < 3; mode++) {
+        long found = 0;
+        double start = bench_now();
+        for (int i = 0; i < records->children->length; i++) {
+            json_jsontoken *record = records->children->tokens[i];
+            json_jsontoken *value = mode == 0 ? bench_pointer_walk(p, record) :
+                mode == 1 ? json_pointer_get(p, record, "/tags/1") :
+                json_pointer_resolve(p, record, compiled);
+            found += value != NULL;
+        }
+        double elapsed = bench_now() - start;
+        printf("pointer: %-16s %.1fns per record (%ld found)\n", labels[mode],
+            elapsed / records->children->length * 1e9, found);
+    }
+    json_pointer_release(compiled);
+    json_parser_cleanup(p);
+    free(input);
+}
+
+/** The same paths run on every record, compiled per record against once */
+static void
+bench_path(void)
+{
+    char *input = bench_gen_records(100000);
+    json_parser *p = json_parser_create_arena(input);
+    json_parsevalue(p, p->all_tokens->tokens[0]);
+    json_jsontoken *records = p->all_tokens->tokens[1];
+    const char *texts[4] = {"$.name", "$.tags[-1]", "$..id", "$.tags[?(@ == 'a')]"};
+    json_path *paths[4];
+    for (int i = 0; i < 4; i++)
+        paths[i] = json_path_compile(texts[i]);
+    json_jsontoken *out[8];
+    for (int mode = 0; mode < 2; mode++) {
+        long found = 0;
+        double start = bench_now();
+        for (int r = 0; r < records->children->length; r++) {
+            json_jsontoken *record = records->children->tokens[r];
+            for (int i = 0; i < 4; i++) {
+                json_path *path = mode == 0 ? json_path_compile(texts[i]) : paths[i];
+                found += json_path_query(p, record, path, out, 8);
+                if (mode == 0)
+                    json_path_release(path);
+            }
+        }
+        double elapsed = bench_now() - start;
+        printf("path: %-12s %.1fns per record, 4 paths (%ld found)\n",
+            mode == 0 ? "per record" : "compiled", elapsed / records->children->length * 1e9, found);
+    }
+    for (int i = 0; i < 4; i++)
+        json_path_release(paths[i]);
+    json_parser_cleanup(p);
+    free(input);
+}
+
+/** Three fields of records with hundreds: full parse then lookups, against the cursor */
+static void
+bench_cursor(void)
+{
+    int n = 5000;
+    char *input = bench_gen_wide(n, 200);
+    size_t length = strlen(input);
+    for (int mode = 0; mode < 2; mode++) {
+        long sum = 0;
+        long names = 0;
+        double start = bench_now();
+        if (mode == 0) {
+            json_parser *p = json_parser_create_arena(input);
+            json_parsevalue(p, p->all_tokens->tokens[0]);
+            json_jsontoken *records = p->all_tokens->tokens[1];
+            for (int i = 0; i < records->children->length; i++) {
+                json_jsontoken *record = records->children->tokens[i];
+                int64_t id, ts;
+                int view;
+                json_token_get_int64(p, json_obj_get(p, record, "id", 2), &id);
+                names += json_token_get_string_view(p, json_obj_get(p, record, "name", 4), &view, NULL, 0) != NULL;
+                json_token_get_int64(p, json_obj_get(p, record, "ts", 2), &ts);
+                sum += id + ts;
+            }
+            json_parser_cleanup(p);
+        } else {
+            json_cursor c;
+            json_cursor_init(&c, input, (int) length);
+            json_cursor_enter(&c);
+            while (json_cursor_next_element(&c)) {
+                int64_t id, ts;
+                int view;
+                json_cursor_enter(&c);
+                json_cursor_find_field(&c, "id", 2);
+                json_cursor_get_int64(&c, &id);
+                json_cursor_find_field(&c, "name", 4);
+                names += json_cursor_get_string_view(&c, &view, NULL, 0) != NULL;
+                json_cursor_find_field(&c, "ts", 2);
+                json_cursor_get_int64(&c, &ts);
+                json_cursor_leave(&c);
+                sum += id + ts;
+            }
+        }
+        double elapsed = bench_now() - start;
+        printf("cursor: %-12s %.1f MB/s, 3 of 202 fields (%ld names, sum %ld)\n",
+            mode == 0 ? "full parse" : "cursor", length / elapsed / 1e6, names, sum);
+    }
+    free(input);
+}
+
+/** Accepts only the key "preview" */
+static bool
+bench_skip_preview(void *ctx, const char *key, int length)
+{
+    (void) ctx;
+    return length == 7 && memcmp(key, "preview", 7) == 0;
+}
+
+/** A document that is mostly one "preview" value: parsed, skipped by key, and skipped alone */
+static void
+bench_skip(void)
+{
+    int rounds = 5;
+    char *records = bench_gen_records(200000);
+    bench_buf buf = {NULL, 0, 0};
+    bench_buf_append(&buf, "{\"id\": 1, \"preview\": ");
+    bench_buf_append(&buf, records);
+    bench_buf_append(&buf, ", \"name\": \"x\"}");
+    free(records);
+    int preview = (int) (strstr(buf.data, "[") - buf.data);
+    double start = bench_now();
+    json_parser *p = json_parser_create_arena(buf.data);
+    for (int r = 0; r < rounds; r++) {
+        json_parser_reset(p, buf.data);
+        json_parsevalue(p, p->all_tokens->tokens[0]);
+    }
+    double full = (bench_now() - start) / rounds;
+    int tokens = p->all_tokens->length;
+    json_parser_skip_keys(p, bench_skip_preview, NULL);
+    start = bench_now();
+    for (int r = 0; r < rounds; r++) {
+        json_parser_reset(p, buf.data);
+        json_parsevalue(p, p->all_tokens->tokens[0]);
+    }
+    double keyed = (bench_now() - start) / rounds;
+    printf("skip: %zu bytes, full parse %.1fms (%d tokens), skip_keys %.2fms (%d tokens)\n",
+        buf.length, full * 1e3, tokens, keyed * 1e3, p->all_tokens->length);
+    json_parser_cleanup(p);
+    json_kernel selected = json_kernel_active();
+    for (int k = JSON_KERNEL_SCALAR; k <= JSON_KERNEL_AVX512; k++) {
+        if (!json_kernel_select((json_kernel) k))
+            continue;
+        int end = 0;
+        start = bench_now();
+        for (int r = 0; r < rounds; r++)
+            end = json_skip_value(buf.data, preview, (int) buf.length);
+        double skip = (bench_now() - start) / rounds;
+        printf("  json_skip_value %-7s %.0fMB/s (ends at %d)\n", json_kernel_name((json_kernel) k),
+            (end - preview) / skip / 1e6, end);
+    }
+    json_kernel_select(selected);
+    free(buf.data);
+}
+
+/** Three paths out of ingest records: full parse against a projection, in time and token memory */
+static void
+bench_project(void)
+{
+    int rounds = 3;
+    char *input = bench_gen_ingest(20000);
+    size_t length = strlen(input);
+    const char *paths[3] = {"/*/id", "/*/user/name", "/*/events/*/ts"};
+    json_projection *projection = json_projection_compile(paths, 3);
+    printf("project: %zu bytes of ingest records\n", length);
+    for (int mode = 0; mode < 2; mode++) {
+        double elapsed = 0;
+        size_t memory = 0;
+        int tokens = 0;
+        for (int r = 0; r < rounds; r++) {
+            size_t base = bench_live;
+            json_parser *p = json_parser_create(input);
+            if (mode == 1)
+                json_parser_project(p, projection);
+            double start = bench_now();
+            json_parsevalue(p, p->all_tokens->tokens[0]);
+            elapsed += bench_now() - start;
+            memory = bench_live - base;
+            tokens = p->all_tokens->length;
+            json_parser_cleanup(p);
+        }
+        printf("  %-10s %.1fms, %d tokens, %.1f MB of tokens\n", mode == 0 ? "full" : "projected",
+            elapsed / rounds * 1e3, tokens, memory / 1e6);
+    }
+    json_projection_release(projection);
+    free(input);
+}
+
+/** Ingest records parsed two levels deep, expanding the events of one record in a hundred */
+static void
+bench_shallow(void)
+{
+    int rounds = 3;
+    char *input = bench_gen_ingest(20000);
+    size_t length = strlen(input);
+    printf("shallow: %zu bytes of ingest records\n", length);
+    for (int mode = 0; mode < 2; mode++) {
+        double elapsed = 0;
+        int tokens = 0;
+        long found = 0;
+        for (int r = 0; r < rounds; r++) {
+            json_parser *p = json_parser_create_arena(input);
+            if (mode == 1)
+                json_parser_shallow(p, 2);
+            double start = bench_now();
+            json_parsevalue(p, p->all_tokens->tokens[0]);
+            json_jsontoken *records = p->all_tokens->tokens[1];
+            for (int i = 0; i < records->children->length; i += 100) {
+                json_jsontoken *events = json_obj_get(p, records->children->tokens[i], "events", 6);
+                json_expand(p, events);
+                found += events->children->length;
+            }
+            elapsed += bench_now() - start;
+            tokens = p->all_tokens->length;
+            json_parser_cleanup(p);
+        }
+        printf("  %-8s %.1fms, %d tokens (%ld events read)\n", mode == 0 ? "full" : "shallow",
+            elapsed / rounds * 1e3, tokens, found / rounds);
+    }
+    free(input);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} bench_case;
+
+static const bench_case bench_cases[] = {
+    {"arena", bench_arena},
+    {"tape", bench_tape},
+    {"into", bench_into},
+    {"reset", bench_reset},
+    {"memory", bench_memory},
+    {"columns", bench_columns},
+    {"presize", bench_presize},
+    {"whitespace", bench_whitespace},
+    {"strings", bench_strings},
+    {"indexed", bench_indexed},
+    {"classify", bench_classify},
+    {"kernels", bench_kernels},
+    {"literals", bench_literals},
+    {"convert", bench_convert},
+    {"unescape", bench_unescape},
+    {"utf8", bench_utf8},
+    {"objects", bench_objects},
+    {"pointer", bench_pointer},
+    {"path", bench_path},
+    {"cursor", bench_cursor},
+    {"skip", bench_skip},
+    {"project", bench_project},
+    {"shallow", bench_shallow},
+};
+
+int
+main(int argc, char **argv)
+{
+    int n = sizeof(bench_cases) / sizeof(bench_cases[0]);
+    for (int i = 0; i < n; i++) {
+        if (argc < 2 || strcmp(argv[1], bench_cases[i].name) == 0)
+            bench_cases[i].run();
+    }
+    return 0;
+}
@@ -29,6 +29,34 @@ extern "C" {
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <locale.h>
+#include <float.h>
+#include <limits.h>
+
+/* Numbers strtod has to convert are read in a "C" locale made once, through
+   strtod_l where the C library has it and otherwise by switching the calling
+   thread to it with POSIX.1-2008 uselocale */
+#if defined(__GNUC__) || defined(__clang__)
+#if defined(_GNU_SOURCE) || defined(__APPLE__) || defined(__FreeBSD__)
+#define JSON_STRTOD_L
+#if defined(__APPLE__)
+#include <xlocale.h>
+#endif
+#elif defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L
+#define JSON_USELOCALE
+#endif
+#endif
+
+/* Vector kernels for each x86 ISA level are built with target attributes and
+   picked at runtime, unless JSON_NO_SIMD is defined */
+#if !defined(JSON_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JSON_X86_KERNELS
+#define JSON_TARGET(isa) __attribute__((target(isa)))
+#endif
 
 #define bool int
 #define true 1
@@ -42,10 +70,80 @@ extern "C" {
 /* Expansion factor for lists */
 #define JSON_JSONTOKEN_LIST_EXPANSION(prev_cap) (2*prev_cap)
 
+/* Size of each block of memory requested by an arena parser */
+#define JSON_ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Starting capacity of a parser's tape */
+#define JSON_TAPE_START_CAP 64
+
+/* Starting capacity of a parser's columns */
+#define JSON_COLUMNS_START_CAP 64
+
+/* Low bits of json_tape_entry.next_type that hold the token type */
+#define JSON_TAPE_TYPE_BITS 3
+#define JSON_TAPE_TYPE_MASK ((1u << JSON_TAPE_TYPE_BITS) - 1)
+
+/* Scratch tokens json_parse_into keeps, one per depth including the wrapper,
+   so it takes documents nested up to JSON_TAPE_MAX_DEPTH - 1 deep */
+#define JSON_TAPE_MAX_DEPTH 512
+
+/* Starting capacity of token lists carved from an arena */
+#define JSON_ARENA_LIST_START_CAP 1
+
+/* Alignment of every allocation carved from an arena */
+#define JSON_ARENA_ALIGN 8
+#define JSON_ARENA_ALIGN_UP(n) (((n) + (JSON_ARENA_ALIGN - 1)) & ~((size_t) JSON_ARENA_ALIGN - 1))
+
+/* Byte i of the parser's input, or the terminator once i reaches the end */
+#define JSON_PEEK(parser, i) ((i) < (parser)->end ? (parser)->input[(i)] : STR_END)
+
+/* Character classes in json_char_class: the low bits name the parse function a
+   value starting with the byte dispatches to, the rest are flags */
+#define JSON_CLASS_INVALID 0
+#define JSON_CLASS_NUM 1
+#define JSON_CLASS_STR 2
+#define JSON_CLASS_NULL 3
+#define JSON_CLASS_BOOL 4
+#define JSON_CLASS_OBJ 5
+#define JSON_CLASS_ARR 6
+#define JSON_CLASS_VALUE 0x07
+#define JSON_CLASS_WS 0x08 /** Whitespace */
+#define JSON_CLASS_NUMEND 0x10 /** Ends a number: whitespace, ] } , or the terminator */
+#define JSON_CLASS(c) (json_char_class[(unsigned char) (c)])
+
+/* Starting depth of the container stack kept by json_parse_indexed */
+#define JSON_INDEX_FRAMES_START_CAP 16
+
+/* Bytes UTF-8 checking runs ahead of the parse, small enough to stay in cache */
+#define JSON_UTF8_WINDOW 4096
+
+/* Objects with fewer keys are searched linearly by json_obj_get */
+#define JSON_OBJ_INDEX_MIN 16
+
+/* Longest decoded escaped key json_obj_get compares decoded; longer ones are compared as written */
+#define JSON_OBJ_KEY_MAX 256
+
 /** Forward declaration of tokens and list to hold tokens */
 typedef struct json_jsontoken json_jsontoken;
 typedef struct json_jsontoken_list json_jsontoken_list;
 typedef struct json_parser json_parser;
+typedef struct json_arena_chunk json_arena_chunk;
+typedef struct json_tape_entry json_tape_entry;
+typedef struct json_tape json_tape;
+typedef struct json_columns json_columns;
+typedef struct json_allocator json_allocator;
+typedef struct json_obj_slot json_obj_slot;
+typedef struct json_obj_index json_obj_index;
+typedef struct json_pointer_step json_pointer_step;
+typedef struct json_pointer json_pointer;
+typedef struct json_path_step json_path_step;
+typedef struct json_path json_path;
+typedef struct json_cursor json_cursor;
+typedef struct json_projection_node json_projection_node;
+typedef struct json_projection json_projection;
+
+/** Decides from a key as written, escapes and all, whether to skip its value */
+typedef bool (*json_skip_key)(void *ctx, const char *key, int length);
 
 /** Available types of tokens */
 typedef enum {
@@ -59,14 +157,63 @@ typedef enum {
     JSON_OUT = 7,  /** outer wrapper */
 } json_jsontoken_type;
 
+/** Selector of one JSONPath step */
+typedef enum {
+    JSON_PATH_CHILD = 0,     /** .name or ['name'] */
+    JSON_PATH_WILDCARD = 1,  /** .* or [*], every member value or element */
+    JSON_PATH_INDEX = 2,     /** [n], negative counting from the end */
+    JSON_PATH_SLICE = 3,     /** [start:end:step] */
+    JSON_PATH_FILTER = 4,    /** [?(@.a.b op literal)] or [?(@.a.b)] */
+} json_path_kind;
+
+/** Comparison of a JSONPath filter, JSON_PATH_EXISTS when there is none */
+typedef enum {
+    JSON_PATH_EXISTS = 0,
+    JSON_PATH_EQ = 1,
+    JSON_PATH_NE = 2,
+    JSON_PATH_LT = 3,
+    JSON_PATH_LE = 4,
+    JSON_PATH_GT = 5,
+    JSON_PATH_GE = 6,
+} json_path_op;
+
+/** Outcome of parsing into caller-supplied storage */
+typedef enum {
+    JSON_OK = 0,       /** parsed, all entries written */
+    JSON_INVALID = 1,  /** input is not valid JSON */
+    JSON_NOSPACE = 2,  /** too few entries, count holds the number needed */
+    JSON_TOO_DEEP = 3, /** valid so far, but nested JSON_TAPE_MAX_DEPTH or more deep */
+} json_status;
+
+/** Instruction set levels the scanning kernels are built for */
+typedef enum {
+    JSON_KERNEL_AUTO = 0,    /** widest the CPU supports, or CJSON_KERNEL */
+    JSON_KERNEL_SCALAR = 1,  /** byte at a time, any target */
+    JSON_KERNEL_SSE2 = 2,    /** 16 bytes per step, any x86-64 */
+    JSON_KERNEL_AVX2 = 3,    /** 32 bytes per step */
+    JSON_KERNEL_AVX512 = 4,  /** 64 bytes per step, needs AVX-512BW */
+} json_kernel;
+
+/** Entry points of one kernel level, see json_kernel_select */
+typedef struct json_kernels {
+    json_kernel kernel;
+    int (*skipws)(const char *input, int pos, int end);
+    int (*scanstr)(const char *input, int pos, int end, bool *high);
+    int (*utf8)(const char *input, int pos, int end);
+    uint64_t (*classify)(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *op, uint64_t *ws);
+    void (*brackets)(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *open, uint64_t *close);
+} json_kernels;
+
 /** Token definition */
 struct json_jsontoken {
     json_jsontoken_type type;
+    int index; /** Position of token in all_tokens, i.e. document order */
     json_jsontoken* parent;
     json_jsontoken_list* children;
     int start_in; /** start index of token */
     int end_in; /** End index of token */
     bool error; /** 1 if error exists, 0 otherwise **/
+    bool escaped; /** JSON_STR only: 0 when the text is known to hold no backslash escapes */
 };
 
 /** List definition */
@@ -76,468 +223,4498 @@ struct json_jsontoken_list {
     int capacity;
 };
 
+/** Flat token: one per json_jsontoken, at the same index, packed into
+    16 bytes. Read it through json_tape_type/json_tape_next/json_tape_end. */
+struct json_tape_entry {
+    unsigned int start_in; /** start index of token */
+    unsigned int length; /** end_in - start_in */
+    unsigned int parent; /** Index of the parent entry, 0 for the wrapper */
+    unsigned int next_type; /** Index following the subtree << 3 | type */
+};
+
+/** Tokens laid out contiguously in document order */
+struct json_tape {
+    json_tape_entry* entries;
+    int length;
+    int capacity;
+    bool fixed; /** entries are caller-owned; past capacity only length grows */
+};
+
+/** Tokens stored as parallel arrays, one row per token index, so scans
+    over a single field stay in one dense array */
+struct json_columns {
+    unsigned char* types; /** json_jsontoken_type of each token */
+    int* start_in;
+    int* end_in;
+    int* parent; /** Index of the parent token, -1 for the wrapper */
+    int length;
+    int capacity;
+};
+
+/** Memory callbacks a parser routes all of its allocations through.
+    Sizes are handed back on resize and release for sized allocators. */
+struct json_allocator {
+    void* (*alloc)(void *ctx, size_t size);
+    void* (*resize)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*release)(void *ctx, void *ptr, size_t size);
+    void* ctx; /** Passed to every callback */
+};
+
+/** One key of a json_obj_index, empty while child is 0 */
+struct json_obj_slot {
+    uint32_t hash;
+    int child; /** Position of the key among the object's children, plus one */
+};
+
+/** Open-addressing hash table over one object's keys */
+struct json_obj_index {
+    int capacity; /** Power of two, at least twice the number of keys */
+    json_obj_slot* slots; /** Carved right after the index */
+};
+
+/** One reference token of a compiled JSON Pointer, already unescaped */
+struct json_pointer_step {
+    const char* key;
+    int length;
+    int index; /** Array index the token spells, -1 if it spells none */
+    uint32_t hash; /** json_key_hash of key */
+};
+
+/** JSON Pointer (RFC 6901) parsed once by json_pointer_compile */
+struct json_pointer {
+    int length; /** Number of steps, 0 for the whole document */
+    json_pointer_step* steps; /** Carved right after the pointer, keys after them */
+};
+
+/** One step of a compiled JSONPath */
+struct json_path_step {
+    json_path_kind kind;
+    bool descend; /** Reached through "..": applies to the node and every descendant */
+    const char* key; /** CHILD: member name; FILTER: string literal */
+    int length;
+    uint32_t hash; /** CHILD: json_key_hash of key */
+    int start, end, step; /** INDEX: start; SLICE: bounds, INT_MIN where omitted */
+    json_pointer_step* members; /** FILTER: names after '@' */
+    int members_length;
+    json_path_op op; /** FILTER */
+    json_jsontoken_type literal; /** FILTER: JSON_STR, JSON_FLO, JSON_BOO or JSON_NUL */
+    double number; /** FILTER: numeric literal, or 1/0 for true/false */
+};
+
+/** JSONPath parsed once by json_path_compile */
+struct json_path {
+    int length;
+    json_path_step* steps; /** The rest of the block holds the steps, filter names and keys */
+};
+
+/**
+ * Forward-only reader that builds no tokens. Between moves the cursor may
+ * sit before a pending value, which a getter consumes or the next move skips.
+ */
+struct json_cursor {
+    const char* input;
+    int curr;
+    int end;
+    int depth;    /** Containers entered and not yet left */
+    bool first;   /** No member read yet in the innermost container */
+    bool pending; /** A value starts at curr */
+    bool error;   /** Input was malformed, every later call fails */
+};
+
+/** One step of a json_projection, in a trie over the steps of all its paths */
+struct json_projection_node {
+    const char* key; /** Unescaped step, NULL for the wildcard * */
+    int length;
+    int index; /** Array index the step spells, -1 if none */
+    int child; /** First child node, -1 for none */
+    int next; /** Next sibling node, -1 for none */
+    bool keep; /** A path ends here, so the whole value is kept */
+};
+
+/** Set of paths compiled by json_projection_compile; node 0 is the document */
+struct json_projection {
+    int length;
+    int capacity;
+    json_projection_node* nodes;
+    json_pointer** pointers; /** The compiled paths, which own the step keys */
+    int pointers_length;
+};
+
+/** Block of memory that arena allocations are carved from */
+struct json_arena_chunk {
+    json_arena_chunk* next;
+    size_t used; /** Bytes handed out, including this header */
+    size_t capacity; /** Total bytes in the block */
+};
+
 /* Representing the parser */
 struct json_parser {
-    json_jsontoken_list* all_tokens;
+    json_jsontoken_list* all_tokens; /** NULL when parsing straight into a tape */
     char* input;
     int start;
     int curr;
-    int end;
+    int end; /** Length of input; reading at or past it yields STR_END */
+    json_arena_chunk* arena; /** NULL unless created by json_parser_create_arena */
+    json_tape* tape; /** NULL unless enabled by json_parser_enable_tape */
+    json_columns* columns; /** NULL unless enabled by json_parser_enable_columns */
+    json_jsontoken* scratch; /** One token per depth when there is no tree */
+    json_jsontoken* last; /** Most recently created token */
+    int retained; /** Heap tokens kept past all_tokens->length for reuse */
+    json_allocator allocator;
+    int* child_counts; /** Exact children per token index, from json_parser_presize, NULL if options skip tokens */
+    int child_counts_length;
+    int* structurals; /** Offsets found by json_parser_structurals, ending with the input length */
+    int structurals_length;
+    int structurals_capacity;
+    bool utf8; /** Check string bodies as UTF-8, set by json_parser_enable_utf8 */
+    int utf8_error; /** Offset of the first invalid UTF-8 sequence, -1 if none */
+    int utf8_checked; /** Input before this offset is known to be valid UTF-8 */
+    json_obj_index** obj_indexes; /** Per token index, built by json_obj_get, NULL until needed */
+    int obj_indexes_length;
+    json_skip_key skip_key; /** NULL unless set by json_parser_skip_keys */
+    void* skip_ctx; /** Passed to skip_key */
+    const json_projection* projection; /** NULL unless set by json_parser_project */
+    int projection_node; /** Node of projection the value being parsed falls under, -1 for none */
+    int shallow; /** Levels of containers parsed, 0 for all, set by json_parser_shallow */
+    int depth; /** Containers open around the value being parsed */
+    unsigned char* lazy; /** Per token index, 1 for a container json_expand has yet to parse */
+    int lazy_length;
 };
 
 /** Forward definitions */
 json_parser* json_parser_create(char *input_source);
+json_parser* json_parser_create_arena(char *input_source);
+json_parser* json_parser_create_with(char *input_source, const json_allocator *allocator, bool use_arena);
+json_parser* json_parser_create_n(const char *buf, size_t len);
+json_parser* json_parser_create_with_n(const char *buf, size_t len, const json_allocator *allocator, bool use_arena);
+void json_parser_reset(json_parser *parser, char *input_source);
+void json_parser_reset_n(json_parser *parser, const char *buf, size_t len);
+bool json_parser_presize(json_parser *parser);
 void json_parser_cleanup(json_parser *parser);
 json_jsontoken* json_jsontoken_create(json_jsontoken_type type, json_jsontoken *parent);
 json_jsontoken_list* json_jsontoken_list_create(int capacity);
 void json_jsontoken_list_append(json_jsontoken_list *list, json_jsontoken *t);
+void* json_arena_alloc(json_parser *parser, size_t size);
+json_jsontoken* json_parser_token_create(json_parser *parser, json_jsontoken_type type, json_jsontoken *parent);
+void json_parser_list_append(json_parser *parser, json_jsontoken_list *list, json_jsontoken *t);
+void json_parser_token_close(json_parser *parser, json_jsontoken *token);
+void json_parser_enable_tape(json_parser *parser);
+json_jsontoken_type json_tape_type(const json_tape_entry *entry);
+int json_tape_next(const json_tape_entry *entry);
+int json_tape_end(const json_tape_entry *entry);
+int json_tape_child(json_tape *tape, int i);
+int json_tape_sibling(json_tape *tape, int parent, int i);
+void json_parser_enable_columns(json_parser *parser);
+void json_parser_enable_utf8(json_parser *parser);
+void json_parser_skip_keys(json_parser *parser, json_skip_key skip_key, void *ctx);
+json_projection* json_projection_compile(const char **paths, int count);
+void json_projection_release(json_projection *projection);
+int json_projection_key(const json_projection *projection, int node, const char *key, int length, bool escaped);
+int json_projection_element(const json_projection *projection, int node, int element);
+void json_parser_project(json_parser *parser, const json_projection *projection);
+int json_parser_projection_active(const json_parser *parser);
+bool json_parser_project_member(json_parser *parser, int node, int *child);
+void json_parser_shallow(json_parser *parser, int levels);
+bool json_parser_defer(json_parser *parser, json_jsontoken *token, json_jsontoken *parent);
+bool json_token_is_lazy(const json_parser *parser, const json_jsontoken *token);
+bool json_expand(json_parser *parser, json_jsontoken *token);
+void json_parser_utf8_ahead(json_parser *parser, int limit);
+bool json_parser_check_utf8(json_parser *parser, int start, int end);
+int json_columns_find(json_columns *columns, json_jsontoken_type type, int from);
+int json_columns_count(json_columns *columns, json_jsontoken_type type);
+json_status json_parse_into(char *input, json_tape_entry *entries, int capacity, int *count);
+json_status json_parse_into_n(const char *buf, size_t len, json_tape_entry *entries, int capacity, int *count);
+bool json_kernel_select(json_kernel kernel);
+json_kernel json_kernel_active(void);
+json_kernel json_kernel_default(void);
+const json_kernels* json_kernel_table(json_kernel kernel);
+const json_kernels* json_kernels_get(void);
+bool json_kernel_supported(json_kernel kernel);
+const char* json_kernel_name(json_kernel kernel);
+int json_skipws(const char *input, int pos, int end);
+int json_scanstr(const char *input, int pos, int end);
+int json_scanstr_high(const char *input, int pos, int end, bool *high);
+int json_utf8_sequence(const char *at, int available);
+int json_utf8_check(const char *input, int pos, int end);
+bool json_match4(const char *at, int available, const char *word);
+bool json_parse_int64(const char *at, int length, int64_t *out);
+bool json_parse_uint64(const char *at, int length, uint64_t *out);
+bool json_parse_double(const char *at, int length, double *out);
+bool json_strtod(const char *text, int length, double *out);
+double json_strtod_point(char *copy, int length);
+bool json_token_get_int64(const json_parser *parser, const json_jsontoken *token, int64_t *out);
+bool json_token_get_uint64(const json_parser *parser, const json_jsontoken *token, uint64_t *out);
+bool json_token_get_double(const json_parser *parser, const json_jsontoken *token, double *out);
+int json_unescape(const char *at, int length, char *out, int cap);
+int json_token_get_string(const json_parser *parser, const json_jsontoken *token, char *out, int cap);
+const char* json_token_get_string_view(const json_parser *parser, const json_jsontoken *token, int *length, char *scratch, int cap);
+uint32_t json_key_hash(const char *key, int length);
+void json_parser_obj_indexes_release(json_parser *parser);
+json_jsontoken* json_obj_get(json_parser *parser, json_jsontoken *obj, const char *key, int length);
+json_jsontoken* json_obj_get_hashed(json_parser *parser, json_jsontoken *obj, const char *key, int length, uint32_t hash);
+json_pointer* json_pointer_compile(const char *pointer);
+void json_pointer_release(json_pointer *pointer);
+json_jsontoken* json_pointer_resolve(json_parser *parser, json_jsontoken *root, const json_pointer *pointer);
+json_jsontoken* json_pointer_get(json_parser *parser, json_jsontoken *root, const char *pointer);
+json_path* json_path_compile(const char *path);
+void json_path_release(json_path *path);
+int json_path_query(json_parser *parser, json_jsontoken *root, const json_path *path, json_jsontoken **out, int cap);
+void json_cursor_init(json_cursor *cursor, const char *input, int length);
+json_jsontoken_type json_cursor_type(json_cursor *cursor);
+bool json_cursor_enter(json_cursor *cursor);
+bool json_cursor_leave(json_cursor *cursor);
+bool json_cursor_next_field(json_cursor *cursor, const char **key, int *length);
+bool json_cursor_find_field(json_cursor *cursor, const char *key, int length);
+bool json_cursor_next_element(json_cursor *cursor);
+bool json_cursor_skip(json_cursor *cursor);
+bool json_cursor_get_int64(json_cursor *cursor, int64_t *out);
+bool json_cursor_get_uint64(json_cursor *cursor, uint64_t *out);
+bool json_cursor_get_double(json_cursor *cursor, double *out);
+bool json_cursor_get_bool(json_cursor *cursor, bool *out);
+bool json_cursor_get_null(json_cursor *cursor);
+int json_cursor_get_string(json_cursor *cursor, char *out, int cap);
+const char* json_cursor_get_string_view(json_cursor *cursor, int *length, char *scratch, int cap);
+int json_parser_structurals(json_parser *parser);
+int json_scanstr_close(const char *input, int pos, int end, bool *escaped, bool *high);
+int json_scannum(const char *input, int pos, int end, bool *is_float);
+int json_skip_brackets(const char *input, int pos, int end, int depth);
+int json_skip_value(const char *input, int pos, int end);
+bool json_parse_indexed(json_parser *parser, json_jsontoken *parent);
 bool json_parsearr(json_parser *parser, json_jsontoken *parent);
+bool json_parsearr_members(json_parser *parser, json_jsontoken *arrtoken);
 bool json_parseobj(json_parser *parser, json_jsontoken *parent);
+bool json_parseobj_members(json_parser *parser, json_jsontoken *objtoken);
 bool json_parsestr(json_parser *parser, json_jsontoken *parent);
 bool json_parsenum(json_parser *parser, json_jsontoken *parent);
 bool json_parsebool(json_parser *parser, json_jsontoken *parent);
 bool json_parsenull(json_parser *parser, json_jsontoken *parent);
+bool json_parseinvalid(json_parser *parser, json_jsontoken *parent);
+bool json_parsevalue(json_parser *parser, json_jsontoken *parent);
 
 /** Implementation */
 
+/**
+ * Class of every byte, see JSON_CLASS_*. One lookup replaces the per-byte
+ * switch statements and if/else ladders the parse functions used to run.
+ */
+const unsigned char json_char_class[256] = {
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, /** 00 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** 10 */
+    0x18, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x01, 0x00, 0x00, /** 20 */
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** 30 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** 40 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x10, 0x00, 0x00, /** 50 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, /** 60 */
+    0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x10, 0x00, 0x00, /** 70 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** 80 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** 90 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** a0 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** b0 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** c0 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** d0 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /** e0 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 /** f0 */
+};
+
+/** Parse function for each value class, indexed by JSON_CLASS_VALUE bits */
+typedef bool (*json_value_parser)(json_parser *parser, json_jsontoken *parent);
+const json_value_parser json_value_parsers[JSON_CLASS_VALUE + 1] = {
+    json_parseinvalid,
+    json_parsenum,
+    json_parsestr,
+    json_parsenull,
+    json_parsebool,
+    json_parseobj,
+    json_parsearr,
+    json_parseinvalid,
+};
+
 bool
 json_iswhitespace(char c) {
-    switch (c) {
-        case 0x20:
-        case 0x0c:
-        case 0x0a:
-        case 0x0d:
-        case 0x09:
-        case 0x0b:
-            return true;
-        default:
-            return false;
+    return (JSON_CLASS(c) & JSON_CLASS_WS) != 0;
+}
+
+/**
+ * Scanning kernels. Each one has a scalar version plus, on x86 with GCC or
+ * clang, versions compiled for SSE2, AVX2 and AVX-512BW through target
+ * attributes. The best one the CPU supports is chosen on first use, see
+ * json_kernel_select. Every kernel scans input[pos, end) and returns end
+ * when it finds nothing; vector loads are only issued for whole vectors
+ * before end.
+ */
+
+int
+json_skipws_scalar(const char *input, int pos, int end)
+{
+    while (pos < end && json_iswhitespace(input[pos]))
+        pos++;
+    return pos;
+}
+
+int
+json_scanstr_scalar(const char *input, int pos, int end, bool *high)
+{
+    unsigned char seen = 0;
+    for (; pos < end; pos++) {
+        char c = input[pos];
+        if (c == '"' || c == '\\' || c == STR_END)
+            break;
+        seen |= (unsigned char) c;
     }
+    if (seen & 0x80)
+        *high = true;
+    return pos;
 }
 
+/**
+ * Length of the well-formed UTF-8 sequence at at (RFC 3629: no overlongs,
+ * surrogates or code points past U+10FFFF), or 0 if there is none within
+ * available bytes.
+ */
 int
-json_isnumericalishchar(char c) {
-    switch (c) {
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            return 1;
-        default:
+json_utf8_sequence(const char *at, int available)
+{
+    const unsigned char *u = (const unsigned char*) at;
+    unsigned char low = 0x80, high = 0xbf;
+    int n;
+    if (u[0] < 0x80)
+        return 1;
+    else if (u[0] < 0xc2)
+        return 0;
+    else if (u[0] < 0xe0)
+        n = 2;
+    else if (u[0] < 0xf0) {
+        n = 3;
+        low = u[0] == 0xe0 ? 0xa0 : 0x80;
+        high = u[0] == 0xed ? 0x9f : 0xbf;
+    } else if (u[0] < 0xf5) {
+        n = 4;
+        low = u[0] == 0xf0 ? 0x90 : 0x80;
+        high = u[0] == 0xf4 ? 0x8f : 0xbf;
+    } else
+        return 0;
+    if (available < n || u[1] < low || u[1] > high)
+        return 0;
+    for (int i = 2; i < n; i++)
+        if ((u[i] & 0xc0) != 0x80)
             return 0;
+    return n;
+}
+
+int
+json_utf8_scalar(const char *input, int pos, int end)
+{
+    while (pos < end) {
+        uint64_t word;
+        if (end - pos >= 8) {
+            memcpy(&word, input + pos, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                pos += 8;
+                continue;
+            }
+        }
+        int n = json_utf8_sequence(input + pos, end - pos);
+        if (n == 0)
+            return pos;
+        pos += n;
     }
+    return end;
 }
 
-json_jsontoken_list*
-json_jsontoken_list_create(int capacity)
+uint64_t
+json_index_classify_scalar(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *op, uint64_t *ws)
 {
-    json_jsontoken_list* list;
-    list = (json_jsontoken_list*) malloc(sizeof(json_jsontoken_list));
-    list->capacity = capacity;
-    list->tokens = (json_jsontoken**) malloc(sizeof(json_jsontoken*) * capacity);
-    list->length = 0;
-    return list;
+    uint64_t q = 0, b = 0, o = 0, w = 0, h = 0;
+    for (int i = 0; i < 64; i++) {
+        char c = block[i];
+        uint64_t bit = (uint64_t) 1 << i;
+        if (c & 0x80)
+            h |= bit;
+        else if (c == '"')
+            q |= bit;
+        else if (c == '\\')
+            b |= bit;
+        else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',')
+            o |= bit;
+        else if (json_iswhitespace(c))
+            w |= bit;
+    }
+    *quote = q;
+    *bslash = b;
+    *op = o;
+    *ws = w;
+    return h;
 }
 
 void
-json_jsontoken_list_append
-(json_jsontoken_list *list, json_jsontoken *t)
+json_index_brackets_scalar(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *open, uint64_t *close)
 {
-    if (list->length == list->capacity) {
-        list->capacity = JSON_JSONTOKEN_LIST_EXPANSION(list->capacity);
-        list->tokens = (json_jsontoken**)
-            realloc(list->tokens, sizeof(json_jsontoken*) * list->capacity);
+    uint64_t q = 0, b = 0, o = 0, c = 0;
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = (uint64_t) 1 << i;
+        switch (block[i]) {
+            case '"': q |= bit; break;
+            case '\\': b |= bit; break;
+            case '{': case '[': o |= bit; break;
+            case '}': case ']': c |= bit; break;
+            default: break;
+        }
     }
-    list->tokens[list->length++] = t;
+    *quote = q;
+    *bslash = b;
+    *open = o;
+    *close = c;
 }
 
-json_jsontoken*
-json_jsontoken_create(json_jsontoken_type type, json_jsontoken *parent)
+#if defined(JSON_X86_KERNELS)
+
+JSON_TARGET("sse2") int
+json_skipws_sse2(const char *input, int pos, int end)
 {
-    json_jsontoken *token = (json_jsontoken*) malloc(sizeof(json_jsontoken));
-    token->type = type;
-    token->parent = parent;
-    token->children = json_jsontoken_list_create(JSON_JSONTOKEN_LIST_START_CAP);
-    token->error = false;
-    return token;
+    while (end - pos >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (input + pos));
+        __m128i ctrl = _mm_sub_epi8(chunk, _mm_set1_epi8(0x09));
+        __m128i ws = _mm_or_si128(
+            _mm_cmpeq_epi8(chunk, _mm_set1_epi8(0x20)),
+            _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8(4)), ctrl));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(ws) & 0xffff;
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+    return json_skipws_scalar(input, pos, end);
 }
 
-json_parser*
-json_parser_create(char *input_source)
+JSON_TARGET("sse2") int
+json_scanstr_sse2(const char *input, int pos, int end, bool *high)
 {
-    json_parser *parser = (json_parser*) malloc(sizeof(json_parser));
-    parser->all_tokens = json_jsontoken_list_create(JSON_JSONTOKEN_LIST_START_CAP);
-    parser->start = 0;
-    parser->input = input_source;
-    parser->curr = 0;
-    json_jsontoken *outer = json_jsontoken_create(JSON_OUT, NULL);
-    json_jsontoken_list_append(
-        parser->all_tokens,
-        outer
-    );
-    return parser;
+    __m128i seen = _mm_setzero_si128();
+    while (end - pos >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (input + pos));
+        __m128i stop = _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+            _mm_cmpeq_epi8(chunk, _mm_setzero_si128()));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(stop);
+        if (mask != 0) {
+            /** Only the bytes before the stop were passed over */
+            if ((_mm_movemask_epi8(seen) | (_mm_movemask_epi8(chunk) & (mask - 1) & ~mask)) != 0)
+                *high = true;
+            return pos + __builtin_ctz(mask);
+        }
+        seen = _mm_or_si128(seen, chunk);
+        pos += 16;
+    }
+    if (_mm_movemask_epi8(seen) != 0)
+        *high = true;
+    return json_scanstr_scalar(input, pos, end, high);
 }
 
-bool
-json_parsestr(json_parser *parser, json_jsontoken *parent)
+/** ASCII runs a vector at a time; other sequences one at a time */
+JSON_TARGET("sse2") int
+json_utf8_sse2(const char *input, int pos, int end)
 {
-    json_jsontoken *strtoken = json_jsontoken_create(JSON_STR, parent);
-    json_jsontoken_list_append(
-        parser->all_tokens,
-        strtoken
-    );
-    if (parser->input[parser->curr++] != '"') {
-        strtoken->start_in = parser->curr - 1;
-        strtoken->end_in = -1;
-        parent->error = true;
-        return false;
-    }
-    char curr_c;
-    int slshd = 0;
-    strtoken->start_in = parser->curr;
-    strtoken->type = JSON_STR;
-    while (1) {
-        curr_c = parser->input[parser->curr++];
-        if (curr_c == STR_END) {
-            parent->error = true;
-            return false;
-        }
-        else if (curr_c == '\"' && !slshd) {
-            json_jsontoken_list_append(
-                parent->children,
-                strtoken
-            );
-            strtoken->end_in = parser->curr - 1;
-            return true;
+    while (end - pos >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (input + pos));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(chunk);
+        if (mask == 0) {
+            pos += 16;
+            continue;
         }
-        else if (curr_c == '\\') slshd = 2;
-        else slshd = 1;
-        --slshd;
+        pos += __builtin_ctz(mask);
+        int n = json_utf8_sequence(input + pos, end - pos);
+        if (n == 0)
+            return pos;
+        pos += n;
     }
+    return json_utf8_scalar(input, pos, end);
 }
 
-bool
-json_parsebool(json_parser *parser, json_jsontoken *parent)
+JSON_TARGET("sse2") uint64_t
+json_index_classify_sse2(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *op, uint64_t *ws)
 {
-    json_jsontoken *booltoken = json_jsontoken_create(JSON_BOO, parent);
-    json_jsontoken_list_append(
-        parser->all_tokens,
-        booltoken
-    );
-    bool is_truthy = false;
-    char curr_c = parser->input[parser->curr++];
-    switch (curr_c) {
-        case 't':
-            is_truthy = true;
-        case 'f':
-            break;
-        default:
-            parent->error = true;
-            return false;
+    uint64_t q = 0, b = 0, o = 0, w = 0, h = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (block + i));
+        /** '[' and ']' are '{' and '}' without 0x20 */
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8(0x09));
+        __m128i ops = _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        __m128i space = _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(0x20)),
+            _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8(4)), ctrl));
+        q |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        b |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        o |= (uint64_t) _mm_movemask_epi8(ops) << i;
+        w |= (uint64_t) _mm_movemask_epi8(space) << i;
+        h |= (uint64_t) _mm_movemask_epi8(v) << i;
     }
-    booltoken->start_in = parser->curr-1;
-    unsigned int i = 0;
-    char* false_exp = "alse";
-    char* true_exp = "rue";
-    for (; i < 4; i++) {
-        curr_c = parser->input[parser->curr++];
-        if (i == 3 && is_truthy) {
-            parser->curr--;
-            break;
-        }
-        else if (curr_c == STR_END ||
-            (is_truthy && curr_c != true_exp[i]) ||
-            (!is_truthy && curr_c != false_exp[i])) {
-            parent->error = true;
-            return false;
+    *quote = q;
+    *bslash = b;
+    *op = o;
+    *ws = w;
+    return h;
+}
+
+JSON_TARGET("sse2") void
+json_index_brackets_sse2(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *open, uint64_t *close)
+{
+    uint64_t q = 0, b = 0, o = 0, c = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (block + i));
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        q |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        b |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        o |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{'))) << i;
+        c |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))) << i;
+    }
+    *quote = q;
+    *bslash = b;
+    *open = o;
+    *close = c;
+}
+
+JSON_TARGET("avx2") int
+json_skipws_avx2(const char *input, int pos, int end)
+{
+    while (end - pos >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) (input + pos));
+        __m256i ctrl = _mm256_sub_epi8(chunk, _mm256_set1_epi8(0x09));
+        __m256i ws = _mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(0x20)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(ws);
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+        pos += 32;
+    }
+    return json_skipws_scalar(input, pos, end);
+}
+
+JSON_TARGET("avx2") int
+json_scanstr_avx2(const char *input, int pos, int end, bool *high)
+{
+    __m256i seen = _mm256_setzero_si256();
+    while (end - pos >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) (input + pos));
+        __m256i stop = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"')),
+                _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))),
+            _mm256_cmpeq_epi8(chunk, _mm256_setzero_si256()));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(stop);
+        if (mask != 0) {
+            /** Only the bytes before the stop were passed over */
+            if ((_mm256_movemask_epi8(seen) |
+                ((unsigned int) _mm256_movemask_epi8(chunk) & (mask - 1) & ~mask)) != 0)
+                *high = true;
+            return pos + __builtin_ctz(mask);
         }
+        seen = _mm256_or_si256(seen, chunk);
+        pos += 32;
     }
-    json_jsontoken_list_append(
-        parent->children,
-        booltoken
-    );
-    booltoken->end_in = parser->curr;
-    return true;
+    if (_mm256_movemask_epi8(seen) != 0)
+        *high = true;
+    return json_scanstr_scalar(input, pos, end, high);
 }
 
-bool
-json_parsenum(json_parser *parser, json_jsontoken *parent)
+/** Bits of the per-byte error classes json_utf8_avx2 looks up */
+#define JSON_UTF8_TOO_SHORT (1 << 0)
+#define JSON_UTF8_TOO_LONG (1 << 1)
+#define JSON_UTF8_OVERLONG_3 (1 << 2)
+#define JSON_UTF8_TOO_LARGE (1 << 3)
+#define JSON_UTF8_SURROGATE (1 << 4)
+#define JSON_UTF8_OVERLONG_2 (1 << 5)
+#define JSON_UTF8_TOO_LARGE_1000 (1 << 6)
+#define JSON_UTF8_OVERLONG_4 (1 << 6)
+#define JSON_UTF8_TWO_CONTS (1 << 7)
+#define JSON_UTF8_CARRY (JSON_UTF8_TOO_SHORT | JSON_UTF8_TOO_LONG | JSON_UTF8_TWO_CONTS)
+
+/** 16-entry table in both lanes, for _mm256_shuffle_epi8; entries of 0x80 and up are cast to char */
+#define JSON_UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8((char) (a), (char) (b), (char) (c), (char) (d), \
+        (char) (e), (char) (f), (char) (g), (char) (h), (char) (i), (char) (j), \
+        (char) (k), (char) (l), (char) (m), (char) (n), (char) (o), (char) (p), \
+        (char) (a), (char) (b), (char) (c), (char) (d), (char) (e), (char) (f), \
+        (char) (g), (char) (h), (char) (i), (char) (j), (char) (k), (char) (l), \
+        (char) (m), (char) (n), (char) (o), (char) (p))
+
+/**
+ * Validates 32 bytes at a time by looking up the error classes each pair of
+ * adjacent bytes can belong to, by the high and low nibble of the first and
+ * the high nibble of the second, and checking that only the bytes three-
+ * and four-byte leads call for are continuations (Keiser and Lemire,
+ * "Validating UTF-8 In Less Than One Instruction Per Byte"). Blocks say only
+ * whether they are valid, so from the first bad block, and for the tail,
+ * the scalar kernel takes over at the sequence straddling into it and finds
+ * the exact offset.
+ */
+JSON_TARGET("avx2") int
+json_utf8_avx2(const char *input, int pos, int end)
 {
-    json_jsontoken *numtoken = json_jsontoken_create(JSON_INT, parent);
-    json_jsontoken_list_append(
-        parser->all_tokens,
-        numtoken
-    );
-    numtoken->start_in = parser->curr;
-    bool is_first = true;
-    bool seen_dec = false;
-    bool seen_e = false;
-    bool seen_neg = false;
-    bool seen_neg_after_e = false;
-    while (1) {
-        char curr_c = parser->input[parser->curr++];
-        if (
-            (is_first && json_iswhitespace(curr_c)) || 
-            curr_c == STR_END
-        ) {
-            parent->error = true;
-            return false;
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i byte_1_high = JSON_UTF8_TABLE(
+        JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG,
+        JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG,
+        JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS,
+        JSON_UTF8_TOO_SHORT | JSON_UTF8_OVERLONG_2,
+        JSON_UTF8_TOO_SHORT,
+        JSON_UTF8_TOO_SHORT | JSON_UTF8_OVERLONG_3 | JSON_UTF8_SURROGATE,
+        JSON_UTF8_TOO_SHORT | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000 | JSON_UTF8_OVERLONG_4);
+    const __m256i byte_1_low = JSON_UTF8_TABLE(
+        JSON_UTF8_CARRY | JSON_UTF8_OVERLONG_3 | JSON_UTF8_OVERLONG_2 | JSON_UTF8_OVERLONG_4,
+        JSON_UTF8_CARRY | JSON_UTF8_OVERLONG_2,
+        JSON_UTF8_CARRY,
+        JSON_UTF8_CARRY,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000 | JSON_UTF8_SURROGATE,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high = JSON_UTF8_TABLE(
+        JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+        JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+            JSON_UTF8_OVERLONG_3 | JSON_UTF8_TOO_LARGE_1000 | JSON_UTF8_OVERLONG_4,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+            JSON_UTF8_OVERLONG_3 | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+            JSON_UTF8_SURROGATE | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS |
+            JSON_UTF8_SURROGATE | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT);
+    /** Leads in the last three bytes that need more bytes than the block has left */
+    const __m256i last_leads = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char) (0xf0 - 1), (char) (0xe0 - 1), (char) (0xc0 - 1));
+    int start = pos;
+    __m256i prev = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    while (end - pos >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) (input + pos));
+        __m256i error;
+        /** Long ASCII runs go two vectors per step */
+        if (end - pos >= 64 && _mm256_testz_si256(incomplete, incomplete)) {
+            __m256i next = _mm256_loadu_si256((const __m256i*) (input + pos + 32));
+            if (_mm256_movemask_epi8(_mm256_or_si256(chunk, next)) == 0) {
+                prev = next;
+                pos += 64;
+                continue;
+            }
         }
-        else if (json_iswhitespace(curr_c) || curr_c == ']' || curr_c == '}' || curr_c == ',') {
-            parser->curr--;
-            break;
+        if (_mm256_movemask_epi8(chunk) == 0) {
+            error = incomplete;
+        } else {
+            __m256i shifted = _mm256_permute2x128_si256(prev, chunk, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(chunk, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(chunk, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(chunk, shifted, 13);
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(byte_1_high,
+                        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                    _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(byte_2_high,
+                    _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble)));
+            __m256i must_continue = _mm256_and_si256(
+                _mm256_or_si256(
+                    _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xe0 - 0x80))),
+                    _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xf0 - 0x80)))),
+                _mm256_set1_epi8((char) 0x80));
+            error = _mm256_xor_si256(must_continue, special);
         }
-        switch (curr_c) {
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                break;
-            case '.':
-                if (seen_dec) {
-                    parent->error = true;
-                    return false;
-                }
-                seen_dec = true;
-                break;
-            case 'E':
-            case 'e':
-                if (seen_e) {
-                    parent->error = true;
-                    return false;
-                }
-                seen_e = true;
-                break;
-            case '-':
-                if (is_first) {
-                    seen_neg = true;
-                    break;
-                }
-                else if ((seen_neg && !seen_e) || 
-                    (seen_e && seen_neg_after_e)) {
-                    parent->error = true;
-                    return false;
-                } else if (seen_e) {
-                    seen_neg_after_e = true;
-                    break;
-                } else {
-                    parent->error = true;
-                    return false;
-                }
-            default:
-                parent->error = true;
-                return false;
+        if (!_mm256_testz_si256(error, error))
+            break;
+        incomplete = _mm256_subs_epu8(chunk, last_leads);
+        prev = chunk;
+        pos += 32;
+    }
+    /** Back up to the lead of a sequence crossing pos; all before it is valid */
+    for (int back = 1; back <= 3 && pos - back >= start; back++) {
+        unsigned char c = (unsigned char) input[pos - back];
+        if ((c & 0xc0) != 0x80) {
+            if (c >= 0xc0)
+                pos -= back;
+            break;
         }
-        is_first = false;
     }
-    if (seen_dec) numtoken->type = JSON_FLO;
-    numtoken->end_in = parser->curr;
-    json_jsontoken_list_append(
-        parent->children,
-        numtoken
-    );
-    return true;
+    return json_utf8_scalar(input, pos, end);
 }
 
-bool
-json_parsenull(json_parser *parser, json_jsontoken *parent)
+JSON_TARGET("avx2") uint64_t
+json_index_classify_avx2(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *op, uint64_t *ws)
 {
-    json_jsontoken *nulltoken = json_jsontoken_create(JSON_NUL, parent);
-    json_jsontoken_list_append(
-        parser->all_tokens,
-        nulltoken
-    );
-    char *expected = "null";
-    nulltoken->start_in = parser->curr;
-    for (int i = 0; i < 4; i++) {
-        if (expected[i] != parser->input[parser->curr++]) {
-            parent->error = true;
-            return false;
-        }
+    uint64_t q = 0, b = 0, o = 0, w = 0, h = 0;
+    for (int i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (block + i));
+        /** '[' and ']' are '{' and '}' without 0x20 */
+        __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8(0x09));
+        __m256i ops = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        __m256i space = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x20)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl));
+        q |= (uint64_t) (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        b |= (uint64_t) (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+        o |= (uint64_t) (unsigned int) _mm256_movemask_epi8(ops) << i;
+        w |= (uint64_t) (unsigned int) _mm256_movemask_epi8(space) << i;
+        h |= (uint64_t) (unsigned int) _mm256_movemask_epi8(v) << i;
     }
-    nulltoken->end_in = parser->curr;
-    json_jsontoken_list_append(
-        parent->children,
-        nulltoken
-    );
-    return true;
+    *quote = q;
+    *bslash = b;
+    *op = o;
+    *ws = w;
+    return h;
 }
 
-bool
-json_parsearr(json_parser *parser, json_jsontoken *parent)
+JSON_TARGET("avx2") void
+json_index_brackets_avx2(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *open, uint64_t *close)
 {
-    json_jsontoken *arrtoken = json_jsontoken_create(JSON_ARR, parent);
-    json_jsontoken_list_append(
+    uint64_t q = 0, b = 0, o = 0, c = 0;
+    for (int i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (block + i));
+        __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        q |= (uint64_t) (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        b |= (uint64_t) (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+        o |= (uint64_t) (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{'))) << i;
+        c |= (uint64_t) (unsigned int) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))) << i;
+    }
+    *quote = q;
+    *bslash = b;
+    *open = o;
+    *close = c;
+}
+
+JSON_TARGET("avx512bw") int
+json_skipws_avx512(const char *input, int pos, int end)
+{
+    while (end - pos >= 64) {
+        __m512i chunk = _mm512_loadu_si512((const void*) (input + pos));
+        __m512i ctrl = _mm512_sub_epi8(chunk, _mm512_set1_epi8(0x09));
+        uint64_t mask = ~(uint64_t) (
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(0x20)) |
+            _mm512_cmple_epu8_mask(ctrl, _mm512_set1_epi8(4)));
+        if (mask != 0)
+            return pos + __builtin_ctzll(mask);
+        pos += 64;
+    }
+    return json_skipws_scalar(input, pos, end);
+}
+
+JSON_TARGET("avx512bw") int
+json_scanstr_avx512(const char *input, int pos, int end, bool *high)
+{
+    __m512i seen = _mm512_setzero_si512();
+    while (end - pos >= 64) {
+        __m512i chunk = _mm512_loadu_si512((const void*) (input + pos));
+        uint64_t mask = (uint64_t) (
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('"')) |
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\\')) |
+            _mm512_testn_epi8_mask(chunk, chunk));
+        if (mask != 0) {
+            /** Only the bytes before the stop were passed over */
+            if ((_mm512_movepi8_mask(seen) | (_mm512_movepi8_mask(chunk) & (mask - 1) & ~mask)) != 0)
+                *high = true;
+            return pos + __builtin_ctzll(mask);
+        }
+        seen = _mm512_or_si512(seen, chunk);
+        pos += 64;
+    }
+    if (_mm512_movepi8_mask(seen) != 0)
+        *high = true;
+    return json_scanstr_scalar(input, pos, end, high);
+}
+
+JSON_TARGET("avx512bw") uint64_t
+json_index_classify_avx512(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *op, uint64_t *ws)
+{
+    __m512i v = _mm512_loadu_si512((const void*) block);
+    /** '[' and ']' are '{' and '}' without 0x20 */
+    __m512i folded = _mm512_or_si512(v, _mm512_set1_epi8(0x20));
+    __m512i ctrl = _mm512_sub_epi8(v, _mm512_set1_epi8(0x09));
+    *quote = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"'));
+    *bslash = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\\'));
+    *op = _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('{')) |
+        _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('}')) |
+        _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(':')) |
+        _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(','));
+    *ws = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(0x20)) |
+        _mm512_cmple_epu8_mask(ctrl, _mm512_set1_epi8(4));
+    return _mm512_movepi8_mask(v);
+}
+
+JSON_TARGET("avx512bw") void
+json_index_brackets_avx512(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *open, uint64_t *close)
+{
+    __m512i v = _mm512_loadu_si512((const void*) block);
+    __m512i folded = _mm512_or_si512(v, _mm512_set1_epi8(0x20));
+    *quote = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"'));
+    *bslash = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\\'));
+    *open = _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('{'));
+    *close = _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('}'));
+}
+
+#endif
+
+/** One table per kernel level; never written, so a thread can only see a whole one */
+const json_kernels json_kernels_scalar = {JSON_KERNEL_SCALAR, json_skipws_scalar,
+    json_scanstr_scalar, json_utf8_scalar, json_index_classify_scalar, json_index_brackets_scalar};
+#if defined(JSON_X86_KERNELS)
+const json_kernels json_kernels_sse2 = {JSON_KERNEL_SSE2, json_skipws_sse2,
+    json_scanstr_sse2, json_utf8_sse2, json_index_classify_sse2, json_index_brackets_sse2};
+const json_kernels json_kernels_avx2 = {JSON_KERNEL_AVX2, json_skipws_avx2,
+    json_scanstr_avx2, json_utf8_avx2, json_index_classify_avx2, json_index_brackets_avx2};
+/** The UTF-8 lookup is written for AVX2, which every AVX-512BW CPU has */
+const json_kernels json_kernels_avx512 = {JSON_KERNEL_AVX512, json_skipws_avx512,
+    json_scanstr_avx512, json_utf8_avx2, json_index_classify_avx512, json_index_brackets_avx512};
+#endif
+
+/**
+ * Kernels in use, NULL until the first selection. Only ever replaced by
+ * another table with one atomic pointer store, see json_kernels_get.
+ */
+const json_kernels *json_active_kernels = NULL;
+
+const char*
+json_kernel_name(json_kernel kernel)
+{
+    switch (kernel) {
+        case JSON_KERNEL_SCALAR: return "scalar";
+        case JSON_KERNEL_SSE2: return "sse2";
+        case JSON_KERNEL_AVX2: return "avx2";
+        case JSON_KERNEL_AVX512: return "avx512";
+        default: return "auto";
+    }
+}
+
+/** Whether kernel was compiled in and the running CPU can execute it */
+bool
+json_kernel_supported(json_kernel kernel)
+{
+#if defined(JSON_X86_KERNELS)
+    __builtin_cpu_init();
+    switch (kernel) {
+        case JSON_KERNEL_SCALAR: return true;
+        case JSON_KERNEL_SSE2: return __builtin_cpu_supports("sse2");
+        case JSON_KERNEL_AVX2: return __builtin_cpu_supports("avx2");
+        case JSON_KERNEL_AVX512: return __builtin_cpu_supports("avx512bw");
+        default: return false;
+    }
+#else
+    return kernel == JSON_KERNEL_SCALAR;
+#endif
+}
+
+/** The table for kernel, or NULL when it is not supported */
+const json_kernels*
+json_kernel_table(json_kernel kernel)
+{
+    if (!json_kernel_supported(kernel))
+        return NULL;
+    switch (kernel) {
+#if defined(JSON_X86_KERNELS)
+        case JSON_KERNEL_SSE2: return &json_kernels_sse2;
+        case JSON_KERNEL_AVX2: return &json_kernels_avx2;
+        case JSON_KERNEL_AVX512: return &json_kernels_avx512;
+#endif
+        default: return &json_kernels_scalar;
+    }
+}
+
+/**
+ * The kernel JSON_KERNEL_AUTO stands for: the one named by the CJSON_KERNEL
+ * environment variable if the CPU supports it, and otherwise the widest one
+ * the CPU supports.
+ */
+json_kernel
+json_kernel_default(void)
+{
+    const char *name = getenv("CJSON_KERNEL");
+    for (int k = JSON_KERNEL_AVX512; k >= JSON_KERNEL_SCALAR && name != NULL; k--) {
+        if (strcmp(name, json_kernel_name((json_kernel) k)) == 0 &&
+            json_kernel_supported((json_kernel) k))
+            return (json_kernel) k;
+    }
+    for (int k = JSON_KERNEL_AVX512; k > JSON_KERNEL_SCALAR; k--) {
+        if (json_kernel_supported((json_kernel) k))
+            return (json_kernel) k;
+    }
+    return JSON_KERNEL_SCALAR;
+}
+
+/**
+ * Switches every parser in the process to the given kernels, or to those
+ * json_kernel_default picks for JSON_KERNEL_AUTO. Returns false, leaving the
+ * selection alone, for an unsupported kernel. Safe to call while other
+ * threads parse: each kernel call uses either the old table or the new one.
+ */
+bool
+json_kernel_select(json_kernel kernel)
+{
+    const json_kernels *table = json_kernel_table(
+        kernel == JSON_KERNEL_AUTO ? json_kernel_default() : kernel);
+    if (table == NULL)
+        return false;
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_store_n(&json_active_kernels, table, __ATOMIC_RELEASE);
+#else
+    json_active_kernels = table;
+#endif
+    return true;
+}
+
+/**
+ * The kernels in use. The first call picks json_kernel_default and publishes
+ * it with a compare-and-swap, so threads racing on the first parse agree on
+ * one table and never undo a json_kernel_select made meanwhile.
+ */
+const json_kernels*
+json_kernels_get(void)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    const json_kernels *active = __atomic_load_n(&json_active_kernels, __ATOMIC_ACQUIRE);
+    if (active == NULL) {
+        const json_kernels *chosen = json_kernel_table(json_kernel_default());
+        /** On failure active is updated to the table another thread published */
+        if (__atomic_compare_exchange_n(&json_active_kernels, &active, chosen, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            active = chosen;
+    }
+    return active;
+#else
+    if (json_active_kernels == NULL)
+        json_active_kernels = json_kernel_table(json_kernel_default());
+    return json_active_kernels;
+#endif
+}
+
+json_kernel
+json_kernel_active(void)
+{
+    return json_kernels_get()->kernel;
+}
+
+/**
+ * Returns the position of the first non-whitespace character at or after pos,
+ * or end if there is none.
+ */
+int
+json_skipws(const char *input, int pos, int end)
+{
+    if (pos >= end || !json_iswhitespace(input[pos]))
+        return pos;
+    return json_kernels_get()->skipws(input, pos, end);
+}
+
+/**
+ * Returns the position of the first '"', '\\' or NUL at or after pos, the
+ * only bytes that end the plain run of a string body, or end if there is none.
+ */
+int
+json_scanstr(const char *input, int pos, int end)
+{
+    bool high = false;
+    return json_scanstr_high(input, pos, end, &high);
+}
+
+/**
+ * json_scanstr, also setting *high when a byte it passes over is not ASCII.
+ * The kernels OR the bytes together as they go, so a caller learns for free
+ * whether a string body needs checking as UTF-8.
+ */
+int
+json_scanstr_high(const char *input, int pos, int end, bool *high)
+{
+    return json_kernels_get()->scanstr(input, pos, end, high);
+}
+
+/**
+ * Returns the position of the first byte of the first sequence at or after
+ * pos that is not well-formed UTF-8, or end if there is none.
+ */
+int
+json_utf8_check(const char *input, int pos, int end)
+{
+    return json_kernels_get()->utf8(input, pos, end);
+}
+
+/**
+ * Classifies the 64 bytes at block, setting bit i of each mask when byte i is
+ * a quote, a backslash, one of {}[]:, or whitespace. Returns the mask of
+ * bytes that are not ASCII.
+ */
+uint64_t
+json_index_classify(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *op, uint64_t *ws)
+{
+    return json_kernels_get()->classify(block, quote, bslash, op, ws);
+}
+
+/**
+ * Classifies the 64 bytes at block for bracket matching, setting bit i of
+ * each mask when byte i is a quote, a backslash, { or [, or } or ].
+ */
+void
+json_index_brackets(const char *block, uint64_t *quote, uint64_t *bslash, uint64_t *open, uint64_t *close)
+{
+    json_kernels_get()->brackets(block, quote, bslash, open, close);
+}
+
+/**
+ * True when the four bytes at at spell word, compared as one word. Fewer than
+ * four available bytes never match.
+ */
+bool
+json_match4(const char *at, int available, const char *word)
+{
+    uint32_t have, want;
+    if (available < 4)
+        return false;
+    memcpy(&have, at, 4);
+    memcpy(&want, word, 4);
+    return have == want;
+}
+
+int
+json_isnumericalishchar(char c) {
+    return (JSON_CLASS(c) & JSON_CLASS_VALUE) == JSON_CLASS_NUM;
+}
+
+json_jsontoken_list*
+json_jsontoken_list_create(int capacity)
+{
+    json_jsontoken_list* list;
+    list = (json_jsontoken_list*) malloc(sizeof(json_jsontoken_list));
+    list->capacity = capacity;
+    list->tokens = (json_jsontoken**) malloc(sizeof(json_jsontoken*) * capacity);
+    list->length = 0;
+    return list;
+}
+
+void
+json_jsontoken_list_append
+(json_jsontoken_list *list, json_jsontoken *t)
+{
+    if (list->length == list->capacity) {
+        list->capacity = JSON_JSONTOKEN_LIST_EXPANSION(list->capacity);
+        list->tokens = (json_jsontoken**)
+            realloc(list->tokens, sizeof(json_jsontoken*) * list->capacity);
+    }
+    list->tokens[list->length++] = t;
+}
+
+json_jsontoken*
+json_jsontoken_create(json_jsontoken_type type, json_jsontoken *parent)
+{
+    json_jsontoken *token = (json_jsontoken*) malloc(sizeof(json_jsontoken));
+    token->type = type;
+    token->parent = parent;
+    token->children = json_jsontoken_list_create(JSON_JSONTOKEN_LIST_START_CAP);
+    token->error = false;
+    return token;
+}
+
+void*
+json_stdlib_alloc(void *ctx, size_t size)
+{
+    (void) ctx;
+    return malloc(size);
+}
+
+void*
+json_stdlib_resize(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    (void) ctx;
+    (void) old_size;
+    return realloc(ptr, new_size);
+}
+
+void
+json_stdlib_release(void *ctx, void *ptr, size_t size)
+{
+    (void) ctx;
+    (void) size;
+    free(ptr);
+}
+
+void*
+json_parser_alloc(json_parser *parser, size_t size)
+{
+    return parser->allocator.alloc(parser->allocator.ctx, size);
+}
+
+void*
+json_parser_resize(json_parser *parser, void *ptr, size_t old_size, size_t new_size)
+{
+    return parser->allocator.resize(parser->allocator.ctx, ptr, old_size, new_size);
+}
+
+void
+json_parser_release(json_parser *parser, void *ptr, size_t size)
+{
+    parser->allocator.release(parser->allocator.ctx, ptr, size);
+}
+
+json_jsontoken_list*
+json_parser_list_create(json_parser *parser, int capacity)
+{
+    json_jsontoken_list* list;
+    list = (json_jsontoken_list*) json_parser_alloc(parser, sizeof(json_jsontoken_list));
+    list->capacity = capacity;
+    list->tokens = capacity == 0 ? NULL : (json_jsontoken**)
+        json_parser_alloc(parser, sizeof(json_jsontoken*) * capacity);
+    list->length = 0;
+    return list;
+}
+
+void
+json_parser_list_release(json_parser *parser, json_jsontoken_list *list)
+{
+    if (list->tokens != NULL)
+        json_parser_release(parser, list->tokens, sizeof(json_jsontoken*) * list->capacity);
+    json_parser_release(parser, list, sizeof(json_jsontoken_list));
+}
+
+void
+json_parser_list_reserve(json_parser *parser, json_jsontoken_list *list, int capacity)
+{
+    if (capacity <= list->capacity)
+        return;
+    if (list->tokens == NULL) {
+        list->tokens = (json_jsontoken**)
+            json_parser_alloc(parser, sizeof(json_jsontoken*) * capacity);
+    } else {
+        list->tokens = (json_jsontoken**) json_parser_resize(
+            parser,
+            list->tokens,
+            sizeof(json_jsontoken*) * list->capacity,
+            sizeof(json_jsontoken*) * capacity
+        );
+    }
+    list->capacity = capacity;
+}
+
+/** Heap append for lists owned by the parser, like json_jsontoken_list_append
+    but through the parser's allocator */
+void
+json_parser_list_push(json_parser *parser, json_jsontoken_list *list, json_jsontoken *t)
+{
+    if (list->length == list->capacity) {
+        json_parser_list_reserve(parser, list, list->capacity == 0 ?
+            JSON_JSONTOKEN_LIST_START_CAP :
+            JSON_JSONTOKEN_LIST_EXPANSION(list->capacity));
+    }
+    list->tokens[list->length++] = t;
+}
+
+/** Capacity a token's child list should start with: exact once the
+    document has been presized, the fallback otherwise */
+int
+json_parser_child_capacity(json_parser *parser, int index, int fallback)
+{
+    if (index < parser->child_counts_length)
+        return parser->child_counts[index];
+    return fallback;
+}
+
+json_arena_chunk*
+json_arena_chunk_create(json_parser *parser, size_t capacity)
+{
+    json_arena_chunk *chunk = (json_arena_chunk*) json_parser_alloc(parser, capacity);
+    chunk->next = NULL;
+    chunk->used = JSON_ARENA_ALIGN_UP(sizeof(json_arena_chunk));
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+void*
+json_arena_alloc(json_parser *parser, size_t size)
+{
+    json_arena_chunk *chunk = parser->arena;
+    size_t header = JSON_ARENA_ALIGN_UP(sizeof(json_arena_chunk));
+    size = JSON_ARENA_ALIGN_UP(size);
+    if (chunk->used + size > chunk->capacity) {
+        if (header + size > JSON_ARENA_CHUNK_SIZE) {
+            /** Oversized requests get their own block, linked behind the
+                current one so it keeps serving small requests. */
+            json_arena_chunk *big = json_arena_chunk_create(parser, header + size);
+            big->next = chunk->next;
+            chunk->next = big;
+            big->used += size;
+            return (char*) big + header;
+        }
+        chunk = json_arena_chunk_create(parser, JSON_ARENA_CHUNK_SIZE);
+        chunk->next = parser->arena;
+        parser->arena = chunk;
+    }
+    void *mem = (char*) chunk + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+json_jsontoken_type
+json_tape_type(const json_tape_entry *entry)
+{
+    return (json_jsontoken_type) (entry->next_type & JSON_TAPE_TYPE_MASK);
+}
+
+int
+json_tape_next(const json_tape_entry *entry)
+{
+    return (int) (entry->next_type >> JSON_TAPE_TYPE_BITS);
+}
+
+int
+json_tape_end(const json_tape_entry *entry)
+{
+    return (int) (entry->start_in + entry->length);
+}
+
+void
+json_tape_set(json_tape_entry *entry, json_jsontoken_type type, int next)
+{
+    entry->next_type = ((unsigned int) next << JSON_TAPE_TYPE_BITS) | (unsigned int) type;
+}
+
+void
+json_tape_reserve(json_parser *parser, int capacity)
+{
+    json_tape *tape = parser->tape;
+    if (capacity <= tape->capacity)
+        return;
+    tape->entries = (json_tape_entry*) json_parser_resize(
+        parser,
+        tape->entries,
+        sizeof(json_tape_entry) * tape->capacity,
+        sizeof(json_tape_entry) * capacity
+    );
+    tape->capacity = capacity;
+}
+
+void
+json_tape_push(json_parser *parser, json_jsontoken *token)
+{
+    json_tape *tape = parser->tape;
+    if (tape->length >= tape->capacity) {
+        if (tape->fixed) {
+            /** Keep counting so the caller learns how many are needed */
+            tape->length++;
+            return;
+        }
+        json_tape_reserve(parser, JSON_JSONTOKEN_LIST_EXPANSION(tape->capacity));
+    }
+    json_tape_entry *entry = &tape->entries[tape->length++];
+    entry->start_in = 0;
+    entry->length = 0;
+    entry->parent = token->parent == NULL ? 0 : token->parent->index;
+    json_tape_set(entry, token->type, tape->length);
+    /** The outer wrapper spans the whole tape */
+    json_tape_set(&tape->entries[0], JSON_OUT, tape->length);
+}
+
+void
+json_columns_reserve(json_parser *parser, int capacity)
+{
+    json_columns *columns = parser->columns;
+    if (capacity <= columns->capacity)
+        return;
+    size_t old_cap = columns->capacity;
+    size_t cap = capacity;
+    columns->types = (unsigned char*) json_parser_resize(
+        parser, columns->types, sizeof(unsigned char) * old_cap, sizeof(unsigned char) * cap);
+    columns->start_in = (int*) json_parser_resize(
+        parser, columns->start_in, sizeof(int) * old_cap, sizeof(int) * cap);
+    columns->end_in = (int*) json_parser_resize(
+        parser, columns->end_in, sizeof(int) * old_cap, sizeof(int) * cap);
+    columns->parent = (int*) json_parser_resize(
+        parser, columns->parent, sizeof(int) * old_cap, sizeof(int) * cap);
+    columns->capacity = capacity;
+}
+
+void
+json_columns_push(json_parser *parser, json_jsontoken *token)
+{
+    json_columns *columns = parser->columns;
+    if (columns->length == columns->capacity)
+        json_columns_reserve(parser, JSON_JSONTOKEN_LIST_EXPANSION(columns->capacity));
+    int i = columns->length++;
+    columns->types[i] = (unsigned char) token->type;
+    columns->start_in[i] = 0;
+    columns->end_in[i] = 0;
+    columns->parent[i] = token->parent == NULL ? -1 : token->parent->index;
+}
+
+json_jsontoken*
+json_parser_token_create(json_parser *parser, json_jsontoken_type type, json_jsontoken *parent)
+{
+    json_jsontoken *token;
+    if (parser->all_tokens == NULL) {
+        /** Without a tree a token is only needed until its subtree is
+            done, so each depth reuses one slot of the scratch stack. */
+        int depth = parent == NULL ? 0 : (int) (parent - parser->scratch) + 1;
+        if (depth == JSON_TAPE_MAX_DEPTH) {
+            /** Too deep: flag the wrapper so the parse is rejected */
+            parser->scratch[0].error = true;
+            depth--;
+        }
+        token = &parser->scratch[depth];
+        token->type = type;
+        token->parent = parent;
+        token->children = NULL;
+        token->error = false;
+        token->index = parser->tape->length;
+        json_tape_push(parser, token);
+        parser->last = token;
+        return token;
+    } else if (parser->all_tokens->length < parser->retained) {
+        /** Recycle a token left over from before the last reset */
+        token = parser->all_tokens->tokens[parser->all_tokens->length];
+        token->type = type;
+        token->parent = parent;
+        token->children->length = 0;
+        token->error = false;
+    } else if (parser->arena == NULL) {
+        token = (json_jsontoken*) json_parser_alloc(parser, sizeof(json_jsontoken));
+        token->type = type;
+        token->parent = parent;
+        token->children = json_parser_list_create(parser, json_parser_child_capacity(
+            parser, parser->all_tokens->length, JSON_JSONTOKEN_LIST_START_CAP));
+        token->error = false;
+    } else {
+        /** Token and its child list share one carve; the list's backing
+            array is only carved once a child is appended. */
+        token = (json_jsontoken*) json_arena_alloc(
+            parser,
+            JSON_ARENA_ALIGN_UP(sizeof(json_jsontoken)) + sizeof(json_jsontoken_list)
+        );
+        token->type = type;
+        token->parent = parent;
+        token->children = (json_jsontoken_list*)
+            ((char*) token + JSON_ARENA_ALIGN_UP(sizeof(json_jsontoken)));
+        token->children->tokens = NULL;
+        token->children->length = 0;
+        token->children->capacity = 0;
+        token->error = false;
+    }
+    token->index = parser->all_tokens->length;
+    json_parser_list_push(
+        parser,
         parser->all_tokens,
-        arrtoken
+        token
     );
-    arrtoken->start_in = parser->curr;
-    char curr_c = parser->input[parser->curr++];
-    if (curr_c != '[') {
-        parent->error = true;
+    if (parser->tape != NULL)
+        json_tape_push(parser, token);
+    if (parser->columns != NULL)
+        json_columns_push(parser, token);
+    parser->last = token;
+    return token;
+}
+
+void
+json_parser_token_close(json_parser *parser, json_jsontoken *token)
+{
+    if (parser->columns != NULL) {
+        parser->columns->types[token->index] = (unsigned char) token->type;
+        parser->columns->start_in[token->index] = token->start_in;
+        parser->columns->end_in[token->index] = token->end_in;
+    }
+    if (parser->tape == NULL || token->index >= parser->tape->capacity)
+        return;
+    /** Everything appended since the token opened belongs to its subtree */
+    json_tape_entry *entry = &parser->tape->entries[token->index];
+    entry->start_in = (unsigned int) token->start_in;
+    entry->length = (unsigned int) (token->end_in - token->start_in);
+    json_tape_set(entry, token->type, parser->tape->length);
+}
+
+void
+json_parser_list_append
+(json_parser *parser, json_jsontoken_list *list, json_jsontoken *t)
+{
+    if (parser->all_tokens == NULL) {
+        return;
+    } else if (parser->arena == NULL) {
+        json_parser_list_push(parser, list, t);
+        return;
+    }
+    if (list->length == list->capacity) {
+        /** Arena memory can't be resized, so grow by carving a larger
+            array and copying; the old one is released at cleanup. */
+        int capacity = list->capacity == 0 ?
+            json_parser_child_capacity(parser, t->parent->index, JSON_ARENA_LIST_START_CAP) :
+            JSON_JSONTOKEN_LIST_EXPANSION(list->capacity);
+        if (capacity == 0)
+            capacity = JSON_ARENA_LIST_START_CAP;
+        json_jsontoken **tokens = (json_jsontoken**)
+            json_arena_alloc(parser, sizeof(json_jsontoken*) * capacity);
+        if (list->length > 0)
+            memcpy(tokens, list->tokens, sizeof(json_jsontoken*) * list->length);
+        list->tokens = tokens;
+        list->capacity = capacity;
+    }
+    list->tokens[list->length++] = t;
+}
+
+void
+json_arena_reset(json_parser *parser)
+{
+    json_arena_chunk *chunk = parser->arena;
+    if (chunk->next == NULL) {
+        chunk->used = JSON_ARENA_ALIGN_UP(sizeof(json_arena_chunk));
+        return;
+    }
+    /** Coalesce into one chunk as large as everything used so far, so the
+        next document of the same size is served without new chunks. */
+    size_t capacity = 0;
+    while (chunk != NULL) {
+        json_arena_chunk *next = chunk->next;
+        capacity += chunk->capacity;
+        json_parser_release(parser, chunk, chunk->capacity);
+        chunk = next;
+    }
+    parser->arena = json_arena_chunk_create(parser, capacity);
+}
+
+void
+json_parser_reset(json_parser *parser, char *input_source)
+{
+    json_parser_reset_n(parser, input_source, strlen(input_source));
+}
+
+/** Points the parser at the first len bytes of buf, which need no terminator */
+void
+json_parser_reset_n(json_parser *parser, const char *buf, size_t len)
+{
+    if (parser->arena != NULL)
+        json_arena_reset(parser);
+    else if (parser->all_tokens->length > parser->retained)
+        parser->retained = parser->all_tokens->length;
+    parser->all_tokens->length = 0;
+    if (parser->tape != NULL)
+        parser->tape->length = 0;
+    if (parser->columns != NULL)
+        parser->columns->length = 0;
+    if (parser->child_counts != NULL) {
+        /** Counts describe one document only */
+        json_parser_release(parser, parser->child_counts,
+            sizeof(int) * parser->child_counts_length);
+        parser->child_counts = NULL;
+    }
+    parser->child_counts_length = 0;
+    parser->structurals_length = 0;
+    json_parser_obj_indexes_release(parser);
+    parser->projection_node = parser->projection != NULL ? 0 : -1;
+    parser->depth = 0;
+    if (parser->lazy != NULL)
+        memset(parser->lazy, 0, parser->lazy_length);
+    parser->utf8_error = -1;
+    parser->utf8_checked = 0;
+    parser->start = 0;
+    parser->input = (char*) buf;
+    parser->curr = 0;
+    parser->end = (int) len;
+    json_parser_token_create(parser, JSON_OUT, NULL);
+}
+
+
+/** Index of the lowest set bit of a nonzero mask */
+int
+json_ctz64(uint64_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/** Number of set bits in mask */
+int
+json_popcount64(uint64_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(mask);
+#else
+    int n = 0;
+    for (; mask != 0; mask &= mask - 1)
+        n++;
+    return n;
+#endif
+}
+
+/**
+ * Mask of the bytes of one block that are inside strings, from each opening
+ * quote up to its closing one. Drops escaped quotes from *quote first.
+ * *prev_escaped and *in_string carry the state between blocks and start at 0.
+ */
+uint64_t
+json_index_strings(uint64_t *quote, uint64_t bslash, uint64_t *prev_escaped, uint64_t *in_string)
+{
+    /** Each backslash that is not itself escaped escapes the byte after it */
+    uint64_t escaped = *prev_escaped;
+    bslash &= ~*prev_escaped;
+    *prev_escaped = 0;
+    while (bslash != 0) {
+        int i = json_ctz64(bslash);
+        if (i == 63) {
+            *prev_escaped = 1;
+            break;
+        }
+        escaped |= (uint64_t) 1 << (i + 1);
+        bslash &= ~((uint64_t) 3 << i);
+    }
+    *quote &= ~escaped;
+
+    /** Prefix xor of the quotes: set from each opening quote up to its closing one */
+    uint64_t strings = *quote;
+    strings ^= strings << 1;
+    strings ^= strings << 2;
+    strings ^= strings << 4;
+    strings ^= strings << 8;
+    strings ^= strings << 16;
+    strings ^= strings << 32;
+    strings ^= *in_string;
+    *in_string = 0 - (strings >> 63);
+    return strings;
+}
+
+/**
+ * Stage one of the indexed engine. Records in parser->structurals the offset
+ * of every {}[]:, outside a string, every unescaped quote and the first byte
+ * of every other run of non-whitespace, followed by the input length.
+ * Works 64 bytes at a time, carrying escapes and string state across blocks.
+ * Returns the number of offsets recorded.
+ */
+int
+json_parser_structurals(json_parser *parser)
+{
+    const char *input = parser->input;
+    int length = parser->end;
+    uint64_t prev_escaped = 0, in_string = 0, prev_scalar = 0;
+    int n = 0;
+    /** utf8_checked, kept local so the loop does not reload it; -1 when not checking */
+    int checked = parser->utf8 ? parser->utf8_checked : -1;
+    uint64_t (*classify)(const char*, uint64_t*, uint64_t*, uint64_t*, uint64_t*) =
+        json_kernels_get()->classify;
+    for (int base = 0; base < length; base += 64) {
+        const char *block = input + base;
+        char tail[64];
+        if (length - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - base);
+            block = tail;
+        }
+        uint64_t quote, bslash, op, ws;
+        uint64_t high = classify(block, &quote, &bslash, &op, &ws);
+        if (checked >= base && checked < base + 64) {
+            /** An ASCII block is valid as it stands; the lookup only starts at one that is not */
+            if (high == 0) {
+                checked = base + 64 < length ? base + 64 : length;
+            } else {
+                int limit = base + JSON_UTF8_WINDOW;
+                parser->utf8_checked = checked;
+                json_parser_utf8_ahead(parser, limit < length ? limit : length);
+                checked = parser->utf8_checked;
+            }
+        }
+        uint64_t strings = json_index_strings(&quote, bslash, &prev_escaped, &in_string);
+
+        uint64_t scalar = ~(op | ws | quote | strings);
+        uint64_t starts = scalar & ~(scalar << 1 | prev_scalar);
+        prev_scalar = scalar >> 63;
+        uint64_t structural = (op & ~strings) | quote | starts;
+
+        if (n + 65 > parser->structurals_capacity) {
+            int grown = parser->structurals_capacity == 0 ?
+                length / 4 + 65 :
+                JSON_JSONTOKEN_LIST_EXPANSION(parser->structurals_capacity);
+            parser->structurals = parser->structurals == NULL ?
+                (int*) json_parser_alloc(parser, sizeof(int) * grown) :
+                (int*) json_parser_resize(parser, parser->structurals,
+                    sizeof(int) * parser->structurals_capacity, sizeof(int) * grown);
+            parser->structurals_capacity = grown;
+        }
+        while (structural != 0) {
+            parser->structurals[n++] = base + json_ctz64(structural);
+            structural &= structural - 1;
+        }
+    }
+    if (n + 1 > parser->structurals_capacity) {
+        parser->structurals = parser->structurals == NULL ?
+            (int*) json_parser_alloc(parser, sizeof(int)) :
+            (int*) json_parser_resize(parser, parser->structurals,
+                sizeof(int) * parser->structurals_capacity, sizeof(int) * (n + 1));
+        parser->structurals_capacity = n + 1;
+    }
+    parser->structurals[n++] = length;
+    parser->structurals_length = n;
+    if (parser->utf8)
+        parser->utf8_checked = checked;
+    return n;
+}
+
+/**
+ * Position just past the bracket that closes the depth containers open at
+ * pos, or -1 when the input ends first. pos must be outside any string.
+ * Brackets are counted 64 bytes at a time with the same string masks as
+ * json_parser_structurals; a block that closes fewer brackets than are open
+ * cannot end the match, so only the last block is walked bit by bit.
+ */
+int
+json_skip_brackets(const char *input, int pos, int end, int depth)
+{
+    uint64_t prev_escaped = 0, in_string = 0;
+    void (*brackets)(const char*, uint64_t*, uint64_t*, uint64_t*, uint64_t*) =
+        json_kernels_get()->brackets;
+    for (int base = pos; base < end; base += 64) {
+        const char *block = input + base;
+        char tail[64];
+        if (end - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, end - base);
+            block = tail;
+        }
+        uint64_t quote, bslash, open, close;
+        brackets(block, &quote, &bslash, &open, &close);
+        uint64_t strings = json_index_strings(&quote, bslash, &prev_escaped, &in_string);
+        open &= ~strings;
+        close &= ~strings;
+        int closes = json_popcount64(close);
+        if (closes < depth) {
+            depth += json_popcount64(open) - closes;
+            continue;
+        }
+        for (uint64_t both = open | close; both != 0; both &= both - 1) {
+            int i = json_ctz64(both);
+            if (open >> i & 1)
+                depth++;
+            else if (--depth == 0)
+                return base + i + 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Position just past the value starting at the first non-whitespace byte at
+ * or after pos, or -1 when there is no value there or the input ends first.
+ * Creates no tokens. Scalars go through the scanners the parser uses, while
+ * objects and arrays are only matched bracket for bracket by
+ * json_skip_brackets, so nothing inside them is validated.
+ */
+int
+json_skip_value(const char *input, int pos, int end)
+{
+    pos = json_skipws(input, pos, end);
+    if (pos >= end)
+        return -1;
+    bool flag;
+    int close;
+    switch (JSON_CLASS(input[pos]) & JSON_CLASS_VALUE) {
+        case JSON_CLASS_STR:
+            close = json_scanstr_close(input, pos + 1, end, &flag, NULL);
+            return close < 0 ? -1 : close + 1;
+        case JSON_CLASS_NUM:
+            return json_scannum(input, pos, end, &flag);
+        case JSON_CLASS_NULL:
+            return json_match4(input + pos, end - pos, "null") ? pos + 4 : -1;
+        case JSON_CLASS_BOOL:
+            if (json_match4(input + pos, end - pos, "true"))
+                return pos + 4;
+            return input[pos] == 'f' && json_match4(input + pos + 1, end - pos - 1, "alse") ? pos + 5 : -1;
+        case JSON_CLASS_OBJ:
+        case JSON_CLASS_ARR:
+            return json_skip_brackets(input, pos, end, 0);
+        default:
+            return -1;
+    }
+}
+
+/** One open container while json_parse_indexed walks the structurals */
+typedef struct json_index_frame {
+    json_jsontoken *token;
+    json_jsontoken *parent;
+    json_jsontoken *last_key;
+    bool is_key;
+    bool needs_comma;
+} json_index_frame;
+
+/**
+ * Builds the string token whose opening quote is structurals[k], as
+ * json_parsestr would, taking the closing quote from the next offset.
+ */
+bool
+json_index_string(json_parser *parser, json_jsontoken *parent, int k)
+{
+    int open = parser->structurals[k];
+    int close = parser->structurals[k + 1];
+    if (JSON_PEEK(parser, close) != '"'
+        || memchr(parser->input + open + 1, STR_END, close - open - 1)) {
+        /** Unterminated or holding a NUL; the reference path reports it */
+        parser->curr = open;
+        return json_parsestr(parser, parent);
+    }
+    if (!json_parser_check_utf8(parser, open + 1, close)) {
+        parent->error = true;
+        return false;
+    }
+    json_jsontoken *strtoken = json_parser_token_create(parser, JSON_STR, parent);
+    strtoken->start_in = open + 1;
+    /** The index does not keep backslashes; json_token_get_string_view looks */
+    strtoken->escaped = true;
+    json_parser_list_append(parser, parent->children, strtoken);
+    strtoken->end_in = close;
+    json_parser_token_close(parser, strtoken);
+    parser->curr = close + 1;
+    return true;
+}
+
+/**
+ * Stage two of the indexed engine: parses the value at parser->curr like
+ * json_parsevalue, building the same tokens, but finds each next structural
+ * byte and each string's end from json_parser_structurals instead of
+ * scanning. Numbers and literals still go through their parse functions.
+ * Skipped keys, projections and shallow parsing are not supported: with any
+ * of them set it fails at once, setting parent->error.
+ */
+bool
+json_parse_indexed(json_parser *parser, json_jsontoken *parent)
+{
+    if (parser->skip_key != NULL || parser->projection != NULL || parser->shallow > 0) {
+        parent->error = true;
+        return false;
+    }
+    json_parser_structurals(parser);
+    const int *structurals = parser->structurals;
+    int frames_cap = JSON_INDEX_FRAMES_START_CAP;
+    json_index_frame *frames = (json_index_frame*) json_parser_alloc(
+        parser, sizeof(json_index_frame) * frames_cap);
+    int depth = 0;
+    int k = 0;
+    int pos = parser->curr;
+    json_jsontoken *target = parent;
+    bool opening = true;
+    bool ok = true;
+    while (1) {
+        if (opening) {
+            /** Open the value at pos as a child of target */
+            char c = JSON_PEEK(parser, pos);
+            bool done = true;
+            opening = false;
+            while (structurals[k] < pos)
+                k++;
+            if (c == '{' || c == '[') {
+                if (depth == frames_cap) {
+                    frames = (json_index_frame*) json_parser_resize(parser, frames,
+                        sizeof(json_index_frame) * frames_cap,
+                        sizeof(json_index_frame) * 2 * frames_cap);
+                    frames_cap *= 2;
+                }
+                json_index_frame *f = &frames[depth++];
+                f->token = json_parser_token_create(parser, c == '{' ? JSON_OBJ : JSON_ARR, target);
+                f->token->start_in = pos;
+                f->parent = target;
+                f->last_key = NULL;
+                f->is_key = true;
+                f->needs_comma = false;
+                parser->curr = pos + 1;
+                done = false;
+            } else if (c == '\"' && structurals[k] == pos) {
+                ok = json_index_string(parser, target, k);
+            } else {
+                parser->curr = pos;
+                ok = json_parsevalue(parser, target);
+            }
+            if (!ok || depth == 0)
+                break;
+            if (done) {
+                json_index_frame *f = &frames[depth - 1];
+                if (f->token->type == JSON_OBJ) {
+                    json_parser_token_close(parser, f->last_key);
+                    f->is_key = true;
+                }
+                f->needs_comma = true;
+            }
+            continue;
+        }
+
+        /** Next byte that is not whitespace, which is the next structural
+            unless the last value ended mid-run, as in [true1] */
+        json_index_frame *f = &frames[depth - 1];
+        bool is_obj = f->token->type == JSON_OBJ;
+        while (structurals[k] < parser->curr)
+            k++;
+        pos = structurals[k];
+        if (pos > parser->curr && !json_iswhitespace(JSON_PEEK(parser, parser->curr)))
+            pos = parser->curr;
+        char c = JSON_PEEK(parser, pos);
+        parser->curr = pos + 1;
+        if (c == (is_obj ? '}' : ']')) {
+            json_parser_list_append(parser, f->parent->children, f->token);
+            f->token->end_in = parser->curr;
+            json_parser_token_close(parser, f->token);
+            if (--depth == 0)
+                break;
+            f = &frames[depth - 1];
+            if (f->token->type == JSON_OBJ) {
+                json_parser_token_close(parser, f->last_key);
+                f->is_key = true;
+            }
+            f->needs_comma = true;
+        } else if (c == STR_END) {
+            ok = false;
+        } else if (c == ':' && is_obj) {
+            if (!f->is_key || f->last_key == NULL)
+                ok = false;
+            f->is_key = false;
+        } else if (c == ',') {
+            if (!f->needs_comma)
+                ok = false;
+            f->needs_comma = false;
+        } else if (is_obj && f->is_key) {
+            if (c == '\"' && structurals[k] == pos) {
+                ok = json_index_string(parser, f->token, k);
+            } else {
+                parser->curr = pos;
+                ok = json_parsestr(parser, f->token);
+            }
+            f->last_key = parser->last;
+        } else {
+            target = is_obj ? f->last_key : f->token;
+            opening = true;
+        }
+        if (!ok)
+            break;
+    }
+    /** Every open container fails with the value that failed inside it */
+    if (!ok) {
+        for (int d = depth - 1; d >= 0; d--)
+            frames[d].parent->error = true;
+    }
+    json_parser_release(parser, frames, sizeof(json_index_frame) * frames_cap);
+    return ok;
+}
+
+/** Growable int array used by the presize pass */
+void
+json_parser_ints_push(json_parser *parser, int **ints, int *length, int *capacity, int value)
+{
+    if (*length == *capacity) {
+        int grown = *capacity == 0 ?
+            JSON_JSONTOKEN_LIST_START_CAP :
+            JSON_JSONTOKEN_LIST_EXPANSION(*capacity);
+        *ints = *ints == NULL ?
+            (int*) json_parser_alloc(parser, sizeof(int) * grown) :
+            (int*) json_parser_resize(parser, *ints, sizeof(int) * *capacity, sizeof(int) * grown);
+        *capacity = grown;
+    }
+    (*ints)[(*length)++] = value;
+}
+
+/* Kinds of open tokens on the presize stack, kept in the low two bits */
+#define JSON_PRESIZE_OUT 0
+#define JSON_PRESIZE_OBJ 1
+#define JSON_PRESIZE_ARR 2
+#define JSON_PRESIZE_KEY 3
+
+/**
+ * Counts the tokens a parse of the rest of the input will create and
+ * reserves room for them, giving each token's child list its exact size.
+ * With skip keys, a projection or shallow parsing set, fewer tokens are
+ * created than are counted: the reservation is then an upper bound, and
+ * child lists keep their default sizes because the counts no longer line
+ * up with token indices. Returns false when brackets do not balance.
+ */
+bool
+json_parser_presize(json_parser *parser)
+{
+    /** Walks the input once without building tokens, numbering values in
+        the order the parse functions will create them and counting each
+        one's children. Keys are tokens too: children of their object and
+        parents of their value, so they stay on the stack until it ends. */
+    int *counts = NULL, ncounts = 0, counts_cap = 0;
+    int *stack = NULL, depth = 0, stack_cap = 0;
+    for (int i = 0; i < parser->all_tokens->length; i++)
+        json_parser_ints_push(parser, &counts, &ncounts, &counts_cap, 0);
+    json_parser_ints_push(parser, &stack, &depth, &stack_cap, JSON_PRESIZE_OUT);
+    char *input = parser->input;
+    int end = parser->end;
+    int pos = parser->curr;
+    bool ok = true;
+    while (1) {
+        char c = JSON_PEEK(parser, pos);
+        int parent = stack[depth - 1] >> 2;
+        int kind = stack[depth - 1] & 3;
+        if (c == STR_END) {
+            ok = depth == 1;
+            break;
+        } else if (json_iswhitespace(c) || c == ',' || c == ':') {
+            pos++;
+            continue;
+        } else if (c == '}' || c == ']') {
+            if (depth == 1) {
+                ok = false;
+                break;
+            }
+            depth--;
+            pos++;
+        } else {
+            int index = ncounts;
+            counts[parent]++;
+            json_parser_ints_push(parser, &counts, &ncounts, &counts_cap, 0);
+            if (kind != JSON_PRESIZE_OBJ && (c == '{' || c == '[')) {
+                int open = c == '{' ? JSON_PRESIZE_OBJ : JSON_PRESIZE_ARR;
+                json_parser_ints_push(parser, &stack, &depth, &stack_cap, index << 2 | open);
+                pos++;
+                continue;
+            }
+            if (c == '\"') {
+                for (pos = json_scanstr(input, pos + 1, end); JSON_PEEK(parser, pos) == '\\';
+                    pos = json_scanstr(input, pos, end))
+                    pos += JSON_PEEK(parser, pos + 1) != STR_END ? 2 : 1;
+                if (JSON_PEEK(parser, pos) == '\"')
+                    pos++;
+            } else {
+                for (char d = c; d != STR_END && !json_iswhitespace(d) &&
+                    d != ',' && d != ':' && d != ']' && d != '}'; d = JSON_PEEK(parser, pos))
+                    pos++;
+            }
+            if (kind == JSON_PRESIZE_OBJ) {
+                json_parser_ints_push(parser, &stack, &depth, &stack_cap,
+                    index << 2 | JSON_PRESIZE_KEY);
+                continue;
+            }
+        }
+        /** A value just ended; if it belonged to a key, so did the key */
+        if ((stack[depth - 1] & 3) == JSON_PRESIZE_KEY)
+            depth--;
+    }
+    json_parser_release(parser, stack, sizeof(int) * stack_cap);
+    if (parser->child_counts != NULL)
+        json_parser_release(parser, parser->child_counts,
+            sizeof(int) * parser->child_counts_length);
+    parser->child_counts = NULL;
+    parser->child_counts_length = 0;
+    if (parser->skip_key != NULL || parser->projection != NULL || parser->shallow > 0) {
+        json_parser_release(parser, counts, sizeof(int) * counts_cap);
+    } else {
+        /** Keep the array at its allocated size so it can be released exactly */
+        parser->child_counts = counts;
+        parser->child_counts_length = ncounts;
+        if (ncounts < counts_cap) {
+            parser->child_counts = (int*) json_parser_resize(
+                parser, counts, sizeof(int) * counts_cap, sizeof(int) * ncounts);
+        }
+    }
+    json_parser_list_reserve(parser, parser->all_tokens, ncounts);
+    if (parser->tape != NULL)
+        json_tape_reserve(parser, ncounts);
+    if (parser->columns != NULL)
+        json_columns_reserve(parser, ncounts);
+    return ok;
+}
+
+void
+json_parser_init(json_parser *parser, const char *buf, size_t len)
+{
+    parser->all_tokens = json_parser_list_create(parser, JSON_JSONTOKEN_LIST_START_CAP);
+    parser->tape = NULL;
+    parser->columns = NULL;
+    parser->scratch = NULL;
+    parser->retained = 0;
+    parser->child_counts = NULL;
+    parser->structurals = NULL;
+    parser->structurals_capacity = 0;
+    parser->utf8 = false;
+    parser->obj_indexes = NULL;
+    parser->obj_indexes_length = 0;
+    parser->skip_key = NULL;
+    parser->skip_ctx = NULL;
+    parser->projection = NULL;
+    parser->shallow = 0;
+    parser->lazy = NULL;
+    parser->lazy_length = 0;
+    json_parser_reset_n(parser, buf, len);
+}
+
+json_parser*
+json_parser_create_with(char *input_source, const json_allocator *allocator, bool use_arena)
+{
+    return json_parser_create_with_n(input_source, strlen(input_source), allocator, use_arena);
+}
+
+json_parser*
+json_parser_create_with_n(const char *buf, size_t len, const json_allocator *allocator, bool use_arena)
+{
+    json_allocator chosen;
+    if (allocator != NULL) {
+        chosen = *allocator;
+    } else {
+        chosen.alloc = json_stdlib_alloc;
+        chosen.resize = json_stdlib_resize;
+        chosen.release = json_stdlib_release;
+        chosen.ctx = NULL;
+    }
+    json_parser *parser = (json_parser*) chosen.alloc(chosen.ctx, sizeof(json_parser));
+    parser->allocator = chosen;
+    parser->arena = use_arena ?
+        json_arena_chunk_create(parser, JSON_ARENA_CHUNK_SIZE) :
+        NULL;
+    json_parser_init(parser, buf, len);
+    return parser;
+}
+
+json_parser*
+json_parser_create(char *input_source)
+{
+    return json_parser_create_with(input_source, NULL, false);
+}
+
+json_parser*
+json_parser_create_arena(char *input_source)
+{
+    return json_parser_create_with(input_source, NULL, true);
+}
+
+/** Parser over the first len bytes of buf, which need no terminator */
+json_parser*
+json_parser_create_n(const char *buf, size_t len)
+{
+    return json_parser_create_with_n(buf, len, NULL, false);
+}
+
+void
+json_parser_enable_tape(json_parser *parser)
+{
+    json_tape *tape = (json_tape*) json_parser_alloc(parser, sizeof(json_tape));
+    tape->capacity = JSON_TAPE_START_CAP;
+    tape->entries = (json_tape_entry*)
+        json_parser_alloc(parser, sizeof(json_tape_entry) * tape->capacity);
+    tape->length = 0;
+    tape->fixed = false;
+    parser->tape = tape;
+    /** Catch up on tokens that already exist, normally just the wrapper */
+    for (int i = 0; i < parser->all_tokens->length; i++)
+        json_tape_push(parser, parser->all_tokens->tokens[i]);
+}
+
+void
+json_parser_enable_columns(json_parser *parser)
+{
+    json_columns *columns = (json_columns*) json_parser_alloc(parser, sizeof(json_columns));
+    columns->capacity = JSON_COLUMNS_START_CAP;
+    columns->types = (unsigned char*)
+        json_parser_alloc(parser, sizeof(unsigned char) * columns->capacity);
+    columns->start_in = (int*) json_parser_alloc(parser, sizeof(int) * columns->capacity);
+    columns->end_in = (int*) json_parser_alloc(parser, sizeof(int) * columns->capacity);
+    columns->parent = (int*) json_parser_alloc(parser, sizeof(int) * columns->capacity);
+    columns->length = 0;
+    parser->columns = columns;
+    for (int i = 0; i < parser->all_tokens->length; i++)
+        json_columns_push(parser, parser->all_tokens->tokens[i]);
+}
+
+/**
+ * Makes every later parse check the input as UTF-8. A string holding an
+ * invalid sequence fails the parse like a syntax error and the sequence's
+ * offset is kept in utf8_error. Bytes outside strings are already limited
+ * to ASCII by the grammar.
+ */
+void
+json_parser_enable_utf8(json_parser *parser)
+{
+    parser->utf8 = true;
+}
+
+/**
+ * Makes json_parsevalue skip the value of every object member whose key
+ * skip_key accepts, with json_skip_value: the key token is kept with no
+ * value under it, and nothing is created for or checked inside the value.
+ * Pass NULL to parse every value again. json_parse_indexed fails while
+ * this is set.
+ */
+void
+json_parser_skip_keys(json_parser *parser, json_skip_key skip_key, void *ctx)
+{
+    parser->skip_key = skip_key;
+    parser->skip_ctx = ctx;
+}
+
+/**
+ * Checks the input from utf8_checked up to limit in one kernel call and
+ * moves utf8_checked past what is valid, stopping at a bad sequence. The
+ * input is checked in windows rather than per string, so short strings do
+ * not each pay for a call, and each window is checked right before the
+ * parse reaches it, while it is still in cache. Callers only start a window
+ * at a string or block that is not all ASCII.
+ */
+void
+json_parser_utf8_ahead(json_parser *parser, int limit)
+{
+    int checked = json_utf8_check(parser->input, parser->utf8_checked, limit);
+    if (checked < limit) {
+        /** A sequence cut off by limit rather than by the input is fine */
+        int n = json_utf8_sequence(parser->input + checked, parser->end - checked);
+        if (n > 0)
+            checked += n;
+    }
+    parser->utf8_checked = checked;
+}
+
+/** When enabled, checks that the string body [start, end) is valid UTF-8 */
+bool
+json_parser_check_utf8(json_parser *parser, int start, int end)
+{
+    if (!parser->utf8 || end <= parser->utf8_checked)
+        return true;
+    /** Skipped input held only ASCII strings, or bytes the grammar rejects */
+    if (parser->utf8_checked < start)
+        parser->utf8_checked = start;
+    int limit = end + JSON_UTF8_WINDOW;
+    json_parser_utf8_ahead(parser, limit < parser->end ? limit : parser->end);
+    if (end <= parser->utf8_checked)
+        return true;
+    /** Everything before the string was parsed, so the bad sequence is in it */
+    parser->utf8_error = parser->utf8_checked;
+    return false;
+}
+
+int
+json_columns_find(json_columns *columns, json_jsontoken_type type, int from)
+{
+    if (from >= columns->length)
+        return -1;
+    /** memchr scans the type bytes many at a time */
+    unsigned char *found = (unsigned char*)
+        memchr(columns->types + from, (int) type, columns->length - from);
+    return found == NULL ? -1 : (int) (found - columns->types);
+}
+
+int
+json_columns_count(json_columns *columns, json_jsontoken_type type)
+{
+    /** Branch-free so the compiler can vectorize it */
+    int count = 0;
+    for (int i = 0; i < columns->length; i++)
+        count += columns->types[i] == type;
+    return count;
+}
+
+int
+json_tape_child(json_tape *tape, int i)
+{
+    return i + 1 < json_tape_next(&tape->entries[i]) ? i + 1 : -1;
+}
+
+int
+json_tape_sibling(json_tape *tape, int parent, int i)
+{
+    int next = json_tape_next(&tape->entries[i]);
+    return next < json_tape_next(&tape->entries[parent]) ? next : -1;
+}
+
+/**
+ * Position of the quote closing the string whose body starts at pos, or -1
+ * when the input ends first or the body holds a NUL byte. Sets *escaped
+ * when the body has a backslash and, unless high is NULL, *high when it has
+ * a byte that is not ASCII.
+ */
+int
+json_scanstr_close(const char *input, int pos, int end, bool *escaped, bool *high)
+{
+    bool ignored;
+    if (high == NULL)
+        high = &ignored;
+    *escaped = false;
+    *high = false;
+    while (1) {
+        pos = json_scanstr_high(input, pos, end, high);
+        if (pos >= end || input[pos] == STR_END)
+            return -1;
+        if (input[pos] == '"')
+            return pos;
+        /** Backslash: the escaped character never ends the string, but a NUL is never valid */
+        *escaped = true;
+        pos++;
+        if (pos < end && input[pos] != STR_END) {
+            if (input[pos] & 0x80)
+                *high = true;
+            pos++;
+        }
+    }
+}
+
+bool
+json_parsestr(json_parser *parser, json_jsontoken *parent)
+{
+    json_jsontoken *strtoken = json_parser_token_create(parser, JSON_STR, parent);
+    char curr_c = JSON_PEEK(parser, parser->curr);
+    parser->curr++;
+    if (curr_c != '"') {
+        strtoken->start_in = parser->curr - 1;
+        strtoken->end_in = -1;
+        parent->error = true;
+        return false;
+    }
+    strtoken->start_in = parser->curr;
+    strtoken->type = JSON_STR;
+    bool high;
+    int close = json_scanstr_close(parser->input, parser->curr, parser->end, &strtoken->escaped, &high);
+    if (close < 0) {
+        parser->curr = parser->end + 1;
+        parent->error = true;
+        return false;
+    }
+    parser->curr = close + 1;
+    /** An ASCII body needs no check; others are checked while still in cache from the scan */
+    if (high && !json_parser_check_utf8(parser, strtoken->start_in, close)) {
+        parent->error = true;
+        return false;
+    }
+    json_parser_list_append(
+        parser,
+        parent->children,
+        strtoken
+    );
+    strtoken->end_in = close;
+    json_parser_token_close(parser, strtoken);
+    return true;
+}
+
+bool
+json_parsebool(json_parser *parser, json_jsontoken *parent)
+{
+    json_jsontoken *booltoken = json_parser_token_create(parser, JSON_BOO, parent);
+    const char *at = parser->input + parser->curr;
+    int available = parser->end - parser->curr;
+    int length;
+    if (available > 0 && at[0] == 't' && json_match4(at, available, "true"))
+        length = 4;
+    else if (available > 0 && at[0] == 'f' && json_match4(at + 1, available - 1, "alse"))
+        length = 5;
+    else {
+        parent->error = true;
+        return false;
+    }
+    booltoken->start_in = parser->curr;
+    parser->curr += length;
+    json_parser_list_append(
+        parser,
+        parent->children,
+        booltoken
+    );
+    booltoken->end_in = parser->curr;
+    json_parser_token_close(parser, booltoken);
+    return true;
+}
+
+/**
+ * Position just past the number starting at pos, or -1 when it is malformed.
+ * Sets *is_float when the number has a fraction.
+ */
+int
+json_scannum(const char *input, int pos, int end, bool *is_float)
+{
+    bool is_first = true;
+    bool seen_dec = false;
+    bool seen_e = false;
+    bool seen_neg = false;
+    bool seen_neg_after_e = false;
+    while (1) {
+        char curr_c = pos < end ? input[pos] : STR_END;
+        pos++;
+        if (JSON_CLASS(curr_c) & JSON_CLASS_NUMEND) {
+            if (is_first)
+                return -1;
+            pos--;
+            break;
+        }
+        switch (curr_c) {
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+                break;
+            case '.':
+                if (seen_dec)
+                    return -1;
+                seen_dec = true;
+                break;
+            case 'E':
+            case 'e':
+                if (seen_e)
+                    return -1;
+                seen_e = true;
+                break;
+            case '-':
+                if (is_first) {
+                    seen_neg = true;
+                    break;
+                }
+                else if ((seen_neg && !seen_e) || 
+                    (seen_e && seen_neg_after_e)) {
+                    return -1;
+                } else if (seen_e) {
+                    seen_neg_after_e = true;
+                    break;
+                } else {
+                    return -1;
+                }
+            default:
+                return -1;
+        }
+        is_first = false;
+    }
+    *is_float = seen_dec;
+    return pos;
+}
+
+bool
+json_parsenum(json_parser *parser, json_jsontoken *parent)
+{
+    json_jsontoken *numtoken = json_parser_token_create(parser, JSON_INT, parent);
+    numtoken->start_in = parser->curr;
+    bool is_float;
+    int next = json_scannum(parser->input, parser->curr, parser->end, &is_float);
+    if (next < 0) {
+        parent->error = true;
+        return false;
+    }
+    parser->curr = next;
+    if (is_float) numtoken->type = JSON_FLO;
+    numtoken->end_in = parser->curr;
+    json_parser_list_append(
+        parser,
+        parent->children,
+        numtoken
+    );
+    json_parser_token_close(parser, numtoken);
+    return true;
+}
+
+bool
+json_parsenull(json_parser *parser, json_jsontoken *parent)
+{
+    json_jsontoken *nulltoken = json_parser_token_create(parser, JSON_NUL, parent);
+    nulltoken->start_in = parser->curr;
+    if (!json_match4(parser->input + parser->curr, parser->end - parser->curr, "null")) {
+        parent->error = true;
+        return false;
+    }
+    parser->curr += 4;
+    nulltoken->end_in = parser->curr;
+    json_parser_list_append(
+        parser,
+        parent->children,
+        nulltoken
+    );
+    json_parser_token_close(parser, nulltoken);
+    return true;
+}
+
+/** Parses the members of the array at parser->curr into arrtoken, which is open */
+bool
+json_parsearr_members(json_parser *parser, json_jsontoken *arrtoken)
+{
+    char curr_c = JSON_PEEK(parser, parser->curr);
+    parser->curr++;
+    if (curr_c != '[')
+        return false;
+    bool needs_comma = false;
+    bool err_seen = false;
+    int saved_node = parser->projection_node;
+    int node = json_parser_projection_active(parser);
+    int element = 0;
+    while (1) {
+        parser->curr = json_skipws(parser->input, parser->curr, parser->end);
+        curr_c = JSON_PEEK(parser, parser->curr);
+        parser->curr++;
+        if (curr_c == ']') {
+            break;
+        } else if (curr_c == STR_END) {
+            err_seen = true;
+        } else if (curr_c == ',') {
+            if (!needs_comma)
+                err_seen = true;
+            needs_comma = false;
+        } else if (node >= 0) {
+            parser->curr--;
+            int value_node = json_projection_element(parser->projection, node, element++);
+            if (value_node < 0) {
+                parser->curr = json_skip_value(parser->input, parser->curr, parser->end);
+                err_seen = parser->curr < 0;
+            } else {
+                parser->projection_node = value_node;
+                err_seen = !json_parsevalue(parser, arrtoken);
+                parser->projection_node = saved_node;
+            }
+            needs_comma = true;
+        } else {
+            parser->curr--;
+            if (!json_parsevalue(parser, arrtoken))
+                err_seen = true;
+            needs_comma = true;
+        }
+        if (err_seen)
+            return false;
+    }
+    return true;
+}
+
+bool
+json_parsearr(json_parser *parser, json_jsontoken *parent)
+{
+    json_jsontoken *arrtoken = json_parser_token_create(parser, JSON_ARR, parent);
+    arrtoken->start_in = parser->curr;
+    if (parser->shallow > 0 && parser->depth >= parser->shallow &&
+        JSON_PEEK(parser, parser->curr) == '[')
+        return json_parser_defer(parser, arrtoken, parent);
+    parser->depth++;
+    bool ok = json_parsearr_members(parser, arrtoken);
+    parser->depth--;
+    if (!ok) {
+        parent->error = true;
+        return false;
+    }
+    json_parser_list_append(
+        parser,
+        parent->children,
+        arrtoken
+    );
+    arrtoken->end_in = parser->curr;
+    json_parser_token_close(parser, arrtoken);
+    return true;
+}
+
+/** Parses the members of the object at parser->curr into objtoken, which is open */
+bool
+json_parseobj_members(json_parser *parser, json_jsontoken *objtoken)
+{
+    char curr_c = JSON_PEEK(parser, parser->curr);
+    parser->curr++;
+    if (curr_c != '{')
+        return false;
+    bool is_key = true;
+    bool needs_comma = false;
+    bool err_seen = false;
+    json_jsontoken* last_key = NULL;
+    int saved_node = parser->projection_node;
+    int node = json_parser_projection_active(parser);
+    int value_node = -1;
+    while (1) {
+        parser->curr = json_skipws(parser->input, parser->curr, parser->end);
+        curr_c = JSON_PEEK(parser, parser->curr);
+        parser->curr++;
+        if (curr_c == '}')
+            break;
+        else if (curr_c == STR_END)
+            err_seen = true;
+        else if (curr_c == ':') {
+            if (!is_key || last_key == NULL)
+                err_seen = true;
+            is_key = false;
+        } else if (curr_c == ',') {
+            if (!needs_comma)
+                err_seen = true;
+            needs_comma = false;
+        } else if (is_key) {
+            parser->curr--;
+            if (node >= 0 && !json_parser_project_member(parser, node, &value_node)) {
+                err_seen = true;
+            } else if (node >= 0 && value_node < 0) {
+                /** Outside the projection: no tokens for the key or the value */
+                needs_comma = true;
+            } else {
+                if (!json_parsestr(parser, objtoken))
+                    err_seen = true;
+                last_key = parser->last;
+            }
+        } else if (parser->skip_key != NULL && last_key != NULL &&
+            parser->skip_key(parser->skip_ctx, parser->input + last_key->start_in,
+                last_key->end_in - last_key->start_in)) {
+            /** The key stays, with no value under it */
+            parser->curr = json_skip_value(parser->input, parser->curr - 1, parser->end);
+            if (parser->curr < 0)
+                err_seen = true;
+            else
+                json_parser_token_close(parser, last_key);
+            is_key = true;
+            needs_comma = true;
+        } else {
+            parser->curr--;
+            if (node >= 0)
+                parser->projection_node = value_node;
+            if (!json_parsevalue(parser, last_key))
+                err_seen = true;
+            parser->projection_node = saved_node;
+            /** A key's subtree ends with its value */
+            if (!err_seen)
+                json_parser_token_close(parser, last_key);
+            is_key = true;
+            needs_comma = true;
+        }
+        if (err_seen)
+            return false;
+    }
+    return true;
+}
+
+bool
+json_parseobj(json_parser *parser, json_jsontoken *parent)
+{
+    json_jsontoken *objtoken = json_parser_token_create(parser, JSON_OBJ, parent);
+    objtoken->start_in = parser->curr;
+    if (parser->shallow > 0 && parser->depth >= parser->shallow &&
+        JSON_PEEK(parser, parser->curr) == '{')
+        return json_parser_defer(parser, objtoken, parent);
+    parser->depth++;
+    bool ok = json_parseobj_members(parser, objtoken);
+    parser->depth--;
+    if (!ok) {
+        parent->error = true;
+        return false;
+    }
+    json_parser_list_append(
+        parser,
+        parent->children,
+        objtoken
+    );
+    objtoken->end_in = parser->curr;
+    json_parser_token_close(parser, objtoken);
+    return true;
+}
+
+bool
+json_parsevalue(json_parser *parser, json_jsontoken *parent)
+{
+    unsigned char kind = JSON_CLASS(JSON_PEEK(parser, parser->curr)) & JSON_CLASS_VALUE;
+    return json_value_parsers[kind](parser, parent);
+}
+
+bool
+json_parseinvalid(json_parser *parser, json_jsontoken *parent)
+{
+    (void) parser;
+    parent->error = true;
+    return false;
+}
+
+/**
+ * Parses input straight into the caller's tape entries, without creating a
+ * parser or a token tree; entry 0 is the wrapper, as in a parser's tape.
+ * Always sets *count to the number of entries the document needs, so a
+ * JSON_NOSPACE result can be retried with that capacity. Documents nested
+ * JSON_TAPE_MAX_DEPTH or more deep give JSON_TOO_DEEP, as the parser that
+ * walks them lives on the stack; json_parser_enable_tape has no such limit.
+ */
+json_status
+json_parse_into(char *input, json_tape_entry *entries, int capacity, int *count)
+{
+    return json_parse_into_n(input, strlen(input), entries, capacity, count);
+}
+
+/** json_parse_into for the first len bytes of buf, which need no terminator */
+json_status
+json_parse_into_n(const char *buf, size_t len, json_tape_entry *entries, int capacity, int *count)
+{
+    /** Everything lives on this frame or in the caller's entries */
+    json_jsontoken scratch[JSON_TAPE_MAX_DEPTH];
+    json_tape tape;
+    json_parser parser;
+    tape.entries = entries;
+    tape.length = 0;
+    tape.capacity = capacity;
+    tape.fixed = true;
+    parser.all_tokens = NULL;
+    parser.input = (char*) buf;
+    parser.start = 0;
+    parser.curr = 0;
+    parser.end = (int) len;
+    parser.arena = NULL;
+    parser.tape = &tape;
+    parser.columns = NULL;
+    parser.scratch = scratch;
+    parser.retained = 0;
+    parser.child_counts = NULL;
+    parser.child_counts_length = 0;
+    parser.structurals = NULL;
+    parser.structurals_length = 0;
+    parser.structurals_capacity = 0;
+    parser.utf8 = false;
+    parser.utf8_error = -1;
+    parser.utf8_checked = 0;
+    parser.obj_indexes = NULL;
+    parser.obj_indexes_length = 0;
+    parser.skip_key = NULL;
+    parser.skip_ctx = NULL;
+    parser.projection = NULL;
+    parser.projection_node = -1;
+    parser.shallow = 0;
+    parser.depth = 0;
+    parser.lazy = NULL;
+    parser.lazy_length = 0;
+    json_jsontoken *outer = json_parser_token_create(&parser, JSON_OUT, NULL);
+    parser.curr = json_skipws(buf, parser.curr, parser.end);
+    bool ok = json_parsevalue(&parser, outer);
+    *count = tape.length;
+    if (!ok)
+        return JSON_INVALID;
+    parser.curr = json_skipws(buf, parser.curr, parser.end);
+    if (parser.curr != parser.end)
+        return JSON_INVALID;
+    /** Syntax errors fail the parse; only the depth limit flags the wrapper of one that went through */
+    if (outer->error)
+        return JSON_TOO_DEEP;
+    return tape.length > capacity ? JSON_NOSPACE : JSON_OK;
+}
+
+void
+json_parser_cleanup(json_parser *parser)
+{
+    /** Each token has several blocks of memory allocated:
+        - the childrens' token list container
+        - the childrens' token list struct
+        - the token itself
+    */
+    if (parser->arena != NULL) {
+        /** Arena tokens and lists live in the chunks, released in bulk */
+        json_arena_chunk *chunk = parser->arena;
+        while (chunk != NULL) {
+            json_arena_chunk *next = chunk->next;
+            json_parser_release(parser, chunk, chunk->capacity);
+            chunk = next;
+        }
+    } else {
+        int allocated = parser->all_tokens->length > parser->retained ?
+            parser->all_tokens->length : parser->retained;
+        for (int i = 0; i < allocated; i++) {
+            json_jsontoken *token = parser->all_tokens->tokens[i];
+            json_parser_list_release(parser, token->children);
+            json_parser_release(parser, token, sizeof(json_jsontoken));
+        }
+    }
+    if (parser->tape != NULL) {
+        json_parser_release(parser, parser->tape->entries,
+            sizeof(json_tape_entry) * parser->tape->capacity);
+        json_parser_release(parser, parser->tape, sizeof(json_tape));
+    }
+    if (parser->columns != NULL) {
+        size_t capacity = parser->columns->capacity;
+        json_parser_release(parser, parser->columns->types, sizeof(unsigned char) * capacity);
+        json_parser_release(parser, parser->columns->start_in, sizeof(int) * capacity);
+        json_parser_release(parser, parser->columns->end_in, sizeof(int) * capacity);
+        json_parser_release(parser, parser->columns->parent, sizeof(int) * capacity);
+        json_parser_release(parser, parser->columns, sizeof(json_columns));
+    }
+    if (parser->child_counts != NULL)
+        json_parser_release(parser, parser->child_counts,
+            sizeof(int) * parser->child_counts_length);
+    if (parser->structurals != NULL)
+        json_parser_release(parser, parser->structurals,
+            sizeof(int) * parser->structurals_capacity);
+    json_parser_obj_indexes_release(parser);
+    if (parser->lazy != NULL)
+        json_parser_release(parser, parser->lazy, parser->lazy_length);
+    /** Parser follows the same pattern. */
+    json_parser_list_release(parser, parser->all_tokens);
+    json_allocator allocator = parser->allocator;
+    allocator.release(allocator.ctx, parser, sizeof(json_parser));
+}
+
+/**
+ * Number accessors. json_parsenum only validates and records offsets; these
+ * convert a number token's text to a value, checking it against the strict
+ * JSON grammar first. They never depend on the current locale.
+ */
+
+/** Exact powers of ten representable as doubles */
+const double json_pow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+bool
+json_isdigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/** Whether the 8 bytes at p are all digits, tested as one word */
+bool
+json_is_eight_digits(const char *p)
+{
+    uint64_t chunk;
+    memcpy(&chunk, p, 8);
+    return (((chunk & 0xF0F0F0F0F0F0F0F0) |
+        (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+        0x3333333333333333);
+}
+
+/** Value of the 8 digits at p, combined pairwise within one word */
+uint64_t
+json_parse_eight_digits(const char *p)
+{
+    uint64_t chunk;
+    memcpy(&chunk, p, 8);
+#if !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) && \
+    !defined(_M_X64) && !defined(_M_IX86)
+    chunk = ((uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 |
+        (uint64_t) p[3] << 24 | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 |
+        (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56);
+#endif
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8);
+    return (((chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+        (((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+/**
+ * Parses the optional sign and integer digits at at, length bytes in all, as
+ * an unsigned magnitude. Fails on anything but -?(0|[1-9][0-9]*) and on
+ * magnitudes above 2^64 - 1.
+ */
+bool
+json_parse_magnitude(const char *at, int length, bool *negative, uint64_t *magnitude)
+{
+    const char *p = at, *end = at + length;
+    *negative = p < end && *p == '-';
+    if (*negative)
+        p++;
+    int digits = (int) (end - p);
+    if (digits == 0 || digits > 20 || (*p == '0' && digits > 1))
+        return false;
+    uint64_t value = 0;
+    /** 19 digits always fit; a 20th is checked */
+    const char *safe_end = digits > 19 ? p + 19 : end;
+    while (safe_end - p >= 8 && json_is_eight_digits(p)) {
+        value = value * 100000000 + json_parse_eight_digits(p);
+        p += 8;
+    }
+    for (; p < safe_end; p++) {
+        if (!json_isdigit(*p))
+            return false;
+        value = value * 10 + (uint64_t) (*p - '0');
+    }
+    if (p < end) {
+        uint64_t digit = (uint64_t) (*p - '0');
+        if (!json_isdigit(*p) || value > (UINT64_MAX - digit) / 10)
+            return false;
+        value = value * 10 + digit;
+    }
+    *magnitude = value;
+    return true;
+}
+
+/** Parses length bytes at at as a JSON integer that fits in int64_t */
+bool
+json_parse_int64(const char *at, int length, int64_t *out)
+{
+    bool negative;
+    uint64_t magnitude;
+    if (!json_parse_magnitude(at, length, &negative, &magnitude))
+        return false;
+    if (negative) {
+        if (magnitude > (uint64_t) INT64_MAX + 1)
+            return false;
+        *out = magnitude == (uint64_t) INT64_MAX + 1 ? INT64_MIN : -(int64_t) magnitude;
+    } else {
+        if (magnitude > (uint64_t) INT64_MAX)
+            return false;
+        *out = (int64_t) magnitude;
+    }
+    return true;
+}
+
+/** Parses length bytes at at as a non-negative JSON integer that fits in uint64_t */
+bool
+json_parse_uint64(const char *at, int length, uint64_t *out)
+{
+    bool negative;
+    uint64_t magnitude;
+    if (!json_parse_magnitude(at, length, &negative, &magnitude) || negative)
+        return false;
+    *out = magnitude;
+    return true;
+}
+
+#if defined(JSON_STRTOD_L) || defined(JSON_USELOCALE)
+/** The "C" numeric locale json_strtod reads in, created on first use */
+locale_t json_c_numeric = (locale_t) 0;
+
+/** json_c_numeric, or (locale_t) 0 when it cannot be created */
+locale_t
+json_c_numeric_locale(void)
+{
+    locale_t c = __atomic_load_n(&json_c_numeric, __ATOMIC_ACQUIRE);
+    if (c == (locale_t) 0) {
+        locale_t made = newlocale(LC_NUMERIC_MASK, "C", (locale_t) 0);
+        if (made == (locale_t) 0)
+            return made;
+        /** A thread that loses the race frees its copy and uses the winner's */
+        if (__atomic_compare_exchange_n(&json_c_numeric, &c, made, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            c = made;
+        else
+            freelocale(made);
+    }
+    return c;
+}
+#endif
+
+/**
+ * strtod of a valid JSON number in copy, which has room for length + 8
+ * bytes, after swapping '.' for the current locale's decimal point. Only
+ * right while no other thread calls setlocale, so it is the last resort.
+ */
+double
+json_strtod_point(char *copy, int length)
+{
+    const char *point = localeconv()->decimal_point;
+    int point_length = (int) strlen(point);
+    char *dot = (char*) memchr(copy, '.', length);
+    if (dot != NULL && point_length > 0 && point_length <= 8 && strcmp(point, ".") != 0) {
+        /** Moves the digits after the dot along with the terminator */
+        memmove(dot + point_length, dot + 1, length - (dot - copy));
+        memcpy(dot, point, point_length);
+    }
+    return strtod(copy, NULL);
+}
+
+/**
+ * Sets *out to strtod of the valid JSON number in the length bytes at text,
+ * read in the "C" locale whatever the locale of the process or the calling
+ * thread is. Returns false when a number too long for the stack buffer
+ * cannot be copied to the heap.
+ */
+bool
+json_strtod(const char *text, int length, double *out)
+{
+    char local[64];
+    char *copy = length + 8 <= (int) sizeof(local) ? local : (char*) malloc(length + 8);
+    double value;
+    if (copy == NULL)
+        return false;
+    memcpy(copy, text, length);
+    copy[length] = STR_END;
+#if defined(JSON_STRTOD_L) || defined(JSON_USELOCALE)
+    locale_t c = json_c_numeric_locale();
+    if (c != (locale_t) 0) {
+#if defined(JSON_STRTOD_L)
+        value = strtod_l(copy, NULL, c);
+#else
+        locale_t previous = uselocale(c);
+        value = strtod(copy, NULL);
+        uselocale(previous);
+#endif
+    } else
+#endif
+        value = json_strtod_point(copy, length);
+    if (copy != local)
+        free(copy);
+    *out = value;
+    return true;
+}
+
+/**
+ * Parses length bytes at at as a JSON number. Up to 19 significant digits
+ * scaled by a power of ten a double holds exactly are converted with one
+ * correctly rounded multiply or divide (Clinger's fast path). Anything else
+ * goes to json_strtod, so values beyond the range of a double come back as
+ * infinities like strtod's. Returns false for anything that is not a JSON
+ * number, and when memory for converting a long one runs out.
+ */
+bool
+json_parse_double(const char *at, int length, double *out)
+{
+    const char *p = at, *end = at + length;
+    bool negative = p < end && *p == '-';
+    if (negative)
+        p++;
+    if (p == end || !json_isdigit(*p) || (*p == '0' && p + 1 < end && json_isdigit(p[1])))
+        return false;
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exp10 = 0;
+    bool truncated = false;
+    for (; p < end && json_isdigit(*p); p++) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+            significant += mantissa != 0;
+        } else {
+            truncated |= *p != '0';
+            exp10++;
+        }
+    }
+    if (p < end && *p == '.') {
+        const char *fraction = ++p;
+        for (; p < end && json_isdigit(*p); p++) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+                significant += mantissa != 0;
+                exp10--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+        if (p == fraction)
+            return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exp_negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            p++;
+        const char *exp_start = p;
+        int exp = 0;
+        for (; p < end && json_isdigit(*p); p++) {
+            if (exp < 100000)
+                exp = exp * 10 + (*p - '0');
+        }
+        if (p == exp_start)
+            return false;
+        exp10 += exp_negative ? -exp : exp;
+    }
+    if (p != end)
+        return false;
+
+    if (mantissa == 0 && !truncated) {
+        *out = negative ? -0.0 : 0.0;
+        return true;
+    }
+#if FLT_EVAL_METHOD == 0
+    /** Only exact when doubles are not evaluated in wider registers */
+    if (!truncated && mantissa <= ((uint64_t) 1 << 53)) {
+        double value = (double) mantissa;
+        if (exp10 > 22 && exp10 <= 22 + 15) {
+            /** Move the excess into the mantissa while it stays exact */
+            uint64_t scaled = mantissa;
+            while (exp10 > 22 && scaled <= ((uint64_t) 1 << 53) / 10) {
+                scaled *= 10;
+                exp10--;
+            }
+            value = (double) scaled;
+        }
+        if (exp10 >= 0 && exp10 <= 22) {
+            *out = negative ? -(value * json_pow10[exp10]) : value * json_pow10[exp10];
+            return true;
+        }
+        if (exp10 < 0 && exp10 >= -22) {
+            *out = negative ? -(value / json_pow10[-exp10]) : value / json_pow10[-exp10];
+            return true;
+        }
+    }
+#endif
+
+    return json_strtod(at, length, out);
+}
+
+/** Token text of a number token, or false for any other token */
+bool
+json_token_number(const json_parser *parser, const json_jsontoken *token, const char **at, int *length)
+{
+    if (token->type != JSON_INT && token->type != JSON_FLO)
+        return false;
+    *at = parser->input + token->start_in;
+    *length = token->end_in - token->start_in;
+    return true;
+}
+
+bool
+json_token_get_int64(const json_parser *parser, const json_jsontoken *token, int64_t *out)
+{
+    const char *at;
+    int length;
+    return json_token_number(parser, token, &at, &length) &&
+        json_parse_int64(at, length, out);
+}
+
+bool
+json_token_get_uint64(const json_parser *parser, const json_jsontoken *token, uint64_t *out)
+{
+    const char *at;
+    int length;
+    return json_token_number(parser, token, &at, &length) &&
+        json_parse_uint64(at, length, out);
+}
+
+bool
+json_token_get_double(const json_parser *parser, const json_jsontoken *token, double *out)
+{
+    const char *at;
+    int length;
+    return json_token_number(parser, token, &at, &length) &&
+        json_parse_double(at, length, out);
+}
+
+/**
+ * String accessors. json_parsestr only finds where a string ends; these
+ * decode its escapes into UTF-8. Decoding never grows the text, so a buffer
+ * one byte longer than the token's span always fits.
+ */
+
+/** Value of the four hex digits at at, or -1 */
+long
+json_hex4(const char *at)
+{
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = at[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' :
+            c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+            c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0)
+            return -1;
+        value = value << 4 | digit;
+    }
+    return value;
+}
+
+/** Writes the bytes at from to out + o, keeping the last byte of cap for the terminator */
+void
+json_unescape_put(char *out, int cap, int o, const char *from, int n)
+{
+    if (o + 1 < cap)
+        memcpy(out + o, from, o + n < cap ? n : cap - 1 - o);
+}
+
+/**
+ * Decodes the string body of length bytes at at, without its quotes, into
+ * out. Like snprintf, writes at most cap bytes including a terminator and
+ * returns the full decoded length, so a result of cap or more means out was
+ * too small. Returns -1 for an unknown escape, bad hex digits, or a \u
+ * surrogate that is not part of a high/low pair.
+ */
+int
+json_unescape(const char *at, int length, char *out, int cap)
+{
+    int i = 0, o = 0;
+    while (1) {
+        /** Copy up to the next backslash; memchr is vectorized in every
+            libc and, unlike json_scanstr, costs nothing on short strings */
+        const char *backslash = (const char*) memchr(at + i, '\\', length - i);
+        int next = backslash != NULL ? (int) (backslash - at) : length;
+        json_unescape_put(out, cap, o, at + i, next - i);
+        o += next - i;
+        if (next == length)
+            break;
+        if (next + 1 == length)
+            return -1;
+        char c = at[next + 1], decoded[4];
+        int n = 1;
+        i = next + 2;
+        switch (c) {
+        case '"': case '\\': case '/': decoded[0] = c; break;
+        case 'b': decoded[0] = '\b'; break;
+        case 'f': decoded[0] = '\f'; break;
+        case 'n': decoded[0] = '\n'; break;
+        case 'r': decoded[0] = '\r'; break;
+        case 't': decoded[0] = '\t'; break;
+        case 'u': {
+            long cp = length - i >= 4 ? json_hex4(at + i) : -1;
+            if (cp < 0 || (cp >= 0xdc00 && cp <= 0xdfff))
+                return -1;
+            i += 4;
+            if (cp >= 0xd800 && cp <= 0xdbff) {
+                long low = length - i >= 6 && at[i] == '\\' && at[i + 1] == 'u' ?
+                    json_hex4(at + i + 2) : -1;
+                if (low < 0xdc00 || low > 0xdfff)
+                    return -1;
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            if (cp < 0x80) {
+                decoded[0] = (char) cp;
+            } else if (cp < 0x800) {
+                decoded[0] = (char) (0xc0 | cp >> 6);
+                decoded[1] = (char) (0x80 | (cp & 0x3f));
+                n = 2;
+            } else if (cp < 0x10000) {
+                decoded[0] = (char) (0xe0 | cp >> 12);
+                decoded[1] = (char) (0x80 | (cp >> 6 & 0x3f));
+                decoded[2] = (char) (0x80 | (cp & 0x3f));
+                n = 3;
+            } else {
+                decoded[0] = (char) (0xf0 | cp >> 18);
+                decoded[1] = (char) (0x80 | (cp >> 12 & 0x3f));
+                decoded[2] = (char) (0x80 | (cp >> 6 & 0x3f));
+                decoded[3] = (char) (0x80 | (cp & 0x3f));
+                n = 4;
+            }
+            break;
+        }
+        default:
+            return -1;
+        }
+        json_unescape_put(out, cap, o, decoded, n);
+        o += n;
+    }
+    if (cap > 0)
+        out[o < cap ? o : cap - 1] = STR_END;
+    return o;
+}
+
+/** Decoded text of a string token, see json_unescape; -1 for any other token */
+int
+json_token_get_string(const json_parser *parser, const json_jsontoken *token, char *out, int cap)
+{
+    if (token->type != JSON_STR)
+        return -1;
+    return json_unescape(parser->input + token->start_in,
+        token->end_in - token->start_in, out, cap);
+}
+
+/**
+ * Decoded text of a string token without copying when it has no escapes:
+ * returns a pointer into the input, which is not terminated. Otherwise
+ * decodes into scratch and returns it. Either way *length is the decoded
+ * length. Returns NULL for other tokens and bad escapes, setting *length to
+ * -1, and when scratch is too small, setting *length to the size needed.
+ */
+const char*
+json_token_get_string_view(const json_parser *parser, const json_jsontoken *token, int *length, char *scratch, int cap)
+{
+    *length = -1;
+    if (token->type != JSON_STR)
+        return NULL;
+    const char *at = parser->input + token->start_in;
+    int raw = token->end_in - token->start_in;
+    if (!token->escaped || memchr(at, '\\', raw) == NULL) {
+        *length = raw;
+        return at;
+    }
+    int decoded = json_unescape(at, raw, scratch, cap);
+    if (decoded < 0)
+        return NULL;
+    *length = decoded < cap ? decoded : decoded + 1;
+    return decoded < cap ? scratch : NULL;
+}
+
+/**
+ * Object lookup. Small objects are searched in order; from
+ * JSON_OBJ_INDEX_MIN keys up, the first lookup builds a hash index over the
+ * object's keys that later lookups reuse until the parser is reset.
+ */
+
+/** FNV-1a over the key's bytes */
+uint32_t
+json_key_hash(const char *key, int length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char) key[i]) * 16777619u;
+    return hash;
+}
+
+/** Decoded text of key token k, in scratch when it has escapes */
+const char*
+json_obj_key_text(json_parser *parser, json_jsontoken *k, int *length, char *scratch)
+{
+    const char *text = json_token_get_string_view(parser, k, length, scratch, JSON_OBJ_KEY_MAX);
+    if (text == NULL) {
+        /** Too long or badly escaped: compare the text as written */
+        text = parser->input + k->start_in;
+        *length = k->end_in - k->start_in;
+    }
+    return text;
+}
+
+void
+json_parser_obj_indexes_release(json_parser *parser)
+{
+    if (parser->obj_indexes == NULL)
+        return;
+    for (int i = 0; i < parser->obj_indexes_length; i++) {
+        json_obj_index *index = parser->obj_indexes[i];
+        if (index != NULL)
+            json_parser_release(parser, index,
+                sizeof(json_obj_index) + sizeof(json_obj_slot) * index->capacity);
+    }
+    json_parser_release(parser, parser->obj_indexes,
+        sizeof(json_obj_index*) * parser->obj_indexes_length);
+    parser->obj_indexes = NULL;
+    parser->obj_indexes_length = 0;
+}
+
+/** Hash index of obj's keys, built on first use */
+json_obj_index*
+json_parser_obj_index(json_parser *parser, json_jsontoken *obj)
+{
+    if (obj->index >= parser->obj_indexes_length) {
+        int length = parser->all_tokens->length > obj->index ?
+            parser->all_tokens->length : obj->index + 1;
+        parser->obj_indexes = parser->obj_indexes == NULL ?
+            (json_obj_index**) json_parser_alloc(parser, sizeof(json_obj_index*) * length) :
+            (json_obj_index**) json_parser_resize(parser, parser->obj_indexes,
+                sizeof(json_obj_index*) * parser->obj_indexes_length,
+                sizeof(json_obj_index*) * length);
+        memset(parser->obj_indexes + parser->obj_indexes_length, 0,
+            sizeof(json_obj_index*) * (length - parser->obj_indexes_length));
+        parser->obj_indexes_length = length;
+    }
+    json_obj_index *index = parser->obj_indexes[obj->index];
+    if (index != NULL)
+        return index;
+    int keys = obj->children->length;
+    int capacity = 1;
+    while (capacity < 2 * keys)
+        capacity <<= 1;
+    index = (json_obj_index*) json_parser_alloc(parser,
+        sizeof(json_obj_index) + sizeof(json_obj_slot) * capacity);
+    index->capacity = capacity;
+    index->slots = (json_obj_slot*) (index + 1);
+    memset(index->slots, 0, sizeof(json_obj_slot) * capacity);
+    char scratch[JSON_OBJ_KEY_MAX];
+    /** In document order, so a repeated key's first occurrence is probed first */
+    for (int i = 0; i < keys; i++) {
+        int length;
+        const char *text = json_obj_key_text(parser, obj->children->tokens[i], &length, scratch);
+        uint32_t hash = json_key_hash(text, length);
+        int slot = (int) (hash & (uint32_t) (capacity - 1));
+        while (index->slots[slot].child != 0)
+            slot = (slot + 1) & (capacity - 1);
+        index->slots[slot].hash = hash;
+        index->slots[slot].child = i + 1;
+    }
+    parser->obj_indexes[obj->index] = index;
+    return index;
+}
+
+/** True when key token k spells the length bytes at key */
+bool
+json_obj_key_equals(json_parser *parser, json_jsontoken *k, const char *key, int length)
+{
+    int raw = k->end_in - k->start_in;
+    if (!k->escaped)
+        return raw == length && memcmp(parser->input + k->start_in, key, length) == 0;
+    char scratch[JSON_OBJ_KEY_MAX];
+    int text_length;
+    const char *text = json_obj_key_text(parser, k, &text_length, scratch);
+    return text_length == length && memcmp(text, key, length) == 0;
+}
+
+/**
+ * Value of the first member of object token obj whose key decodes to the
+ * length bytes at key, or NULL when there is none or obj is not an object.
+ */
+json_jsontoken*
+json_obj_get(json_parser *parser, json_jsontoken *obj, const char *key, int length)
+{
+    return json_obj_get_hashed(parser, obj, key, length, json_key_hash(key, length));
+}
+
+/** json_obj_get for a key whose json_key_hash is already known */
+json_jsontoken*
+json_obj_get_hashed(json_parser *parser, json_jsontoken *obj, const char *key, int length, uint32_t hash)
+{
+    if (obj->type != JSON_OBJ || obj->children == NULL)
+        return NULL;
+    json_jsontoken **keys = obj->children->tokens;
+    int found = -1;
+    if (obj->children->length < JSON_OBJ_INDEX_MIN) {
+        for (int i = 0; i < obj->children->length && found < 0; i++)
+            if (json_obj_key_equals(parser, keys[i], key, length))
+                found = i;
+    } else {
+        json_obj_index *index = json_parser_obj_index(parser, obj);
+        int mask = index->capacity - 1;
+        for (int slot = (int) (hash & (uint32_t) mask); index->slots[slot].child != 0;
+            slot = (slot + 1) & mask) {
+            json_obj_slot *entry = &index->slots[slot];
+            if (entry->hash == hash &&
+                json_obj_key_equals(parser, keys[entry->child - 1], key, length)) {
+                found = entry->child - 1;
+                break;
+            }
+        }
+    }
+    if (found < 0 || keys[found]->children->length == 0)
+        return NULL;
+    return keys[found]->children->tokens[0];
+}
+
+/**
+ * JSON Pointer (RFC 6901). A pointer is compiled once into unescaped steps
+ * with their array indices and key hashes worked out, then resolved against
+ * any number of documents: array steps index children directly and object
+ * steps go through json_obj_get's hash index.
+ */
+
+/**
+ * Compiles pointer, "" or a sequence of "/token" with "~0" for '~' and
+ * "~1" for '/'. Returns NULL for anything else. Release the result with
+ * json_pointer_release; it does not refer back to pointer.
+ */
+json_pointer*
+json_pointer_compile(const char *pointer)
+{
+    int text = (int) strlen(pointer);
+    if (text > 0 && pointer[0] != '/')
+        return NULL;
+    int steps = 0;
+    for (int i = 0; i < text; i++)
+        steps += pointer[i] == '/';
+    json_pointer *compiled = (json_pointer*) malloc(
+        sizeof(json_pointer) + sizeof(json_pointer_step) * steps + text);
+    compiled->length = steps;
+    compiled->steps = (json_pointer_step*) (compiled + 1);
+    char *keys = (char*) (compiled->steps + steps);
+    int i = 0;
+    for (int s = 0; s < steps; s++) {
+        json_pointer_step *step = &compiled->steps[s];
+        step->key = keys;
+        step->length = 0;
+        for (i++; i < text && pointer[i] != '/'; i++) {
+            char c = pointer[i];
+            if (c == '~') {
+                c = i + 1 < text && pointer[i + 1] == '0' ? '~' :
+                    i + 1 < text && pointer[i + 1] == '1' ? '/' : STR_END;
+                if (c == STR_END) {
+                    free(compiled);
+                    return NULL;
+                }
+                i++;
+            }
+            keys[step->length++] = c;
+        }
+        keys += step->length;
+        step->hash = json_key_hash(step->key, step->length);
+        /** Array indices are 0 or digits without a leading zero */
+        step->index = -1;
+        if (step->length > 0 && step->length <= 9 &&
+            (step->key[0] != '0' || step->length == 1)) {
+            int index = 0;
+            for (int d = 0; d < step->length && index >= 0; d++)
+                index = step->key[d] >= '0' && step->key[d] <= '9' ?
+                    index * 10 + (step->key[d] - '0') : -1;
+            step->index = index;
+        }
+    }
+    return compiled;
+}
+
+void
+json_pointer_release(json_pointer *pointer)
+{
+    free(pointer);
+}
+
+/**
+ * Token the compiled pointer refers to, starting from the value token root,
+ * or NULL when a step names a missing key, an index past the end (including
+ * "-") or descends into a scalar.
+ */
+json_jsontoken*
+json_pointer_resolve(json_parser *parser, json_jsontoken *root, const json_pointer *pointer)
+{
+    json_jsontoken *token = root;
+    for (int s = 0; s < pointer->length && token != NULL; s++) {
+        const json_pointer_step *step = &pointer->steps[s];
+        if (token->type == JSON_OBJ)
+            token = json_obj_get_hashed(parser, token, step->key, step->length, step->hash);
+        else if (token->type == JSON_ARR && step->index >= 0 &&
+            step->index < token->children->length)
+            token = token->children->tokens[step->index];
+        else
+            token = NULL;
+    }
+    return token;
+}
+
+/** json_pointer_resolve for a pointer given as text, compiled on every call */
+json_jsontoken*
+json_pointer_get(json_parser *parser, json_jsontoken *root, const char *pointer)
+{
+    json_pointer *compiled = json_pointer_compile(pointer);
+    if (compiled == NULL)
+        return NULL;
+    json_jsontoken *token = json_pointer_resolve(parser, root, compiled);
+    json_pointer_release(compiled);
+    return token;
+}
+
+/**
+ * JSONPath. A subset of RFC 9535 is compiled once into a list of steps:
+ *   $           the root
+ *   .name ['name'] ["name"]   member by name
+ *   .* [*]      every member value or element
+ *   [n]         element, negative counting from the end
+ *   [a:b:c]     slice, any part optional
+ *   [?(@.x.y op literal)]     children whose member x.y compares true
+ *   [?(@.x.y)]  children that have member x.y
+ *   ..sel       sel applied to the node and all of its descendants
+ * where op is one of == != < <= > >= and a literal is a number, a quoted
+ * string without escapes, true, false or null. Names after '.' run up to
+ * the next '.' or '['. Queries run over a parsed tree.
+ */
+
+/** Reads an optionally signed int at *at, advancing past it; false if there is none */
+bool
+json_path_int(const char **at, int *out)
+{
+    const char *p = *at;
+    bool negative = *p == '-';
+    if (negative)
+        p++;
+    if (*p < '0' || *p > '9')
+        return false;
+    int64_t value = 0;
+    while (*p >= '0' && *p <= '9') {
+        if (value <= INT_MAX)
+            value = value * 10 + (*p - '0');
+        p++;
+    }
+    if (value > INT_MAX)
+        value = INT_MAX;
+    *out = (int) (negative ? -value : value);
+    *at = p;
+    return true;
+}
+
+/** Reads a quoted name at *at into keys, advancing past the closing quote */
+bool
+json_path_quoted(const char **at, char **keys, const char **key, int *length)
+{
+    char quote = **at;
+    const char *close = strchr(*at + 1, quote);
+    if (close == NULL)
+        return false;
+    *key = *keys;
+    *length = (int) (close - *at - 1);
+    memcpy(*keys, *at + 1, *length);
+    *keys += *length;
+    *at = close + 1;
+    return true;
+}
+
+/** Reads the filter at *at, just past "?(", up to and past its ")" */
+bool
+json_path_filter(const char **at, json_path_step *step, json_pointer_step **members, char **keys)
+{
+    const char *p = *at;
+    if (*p++ != '@')
+        return false;
+    step->members = *members;
+    step->members_length = 0;
+    while (*p == '.') {
+        json_pointer_step *member = &step->members[step->members_length++];
+        const char *name = ++p;
+        while (*p != STR_END && strchr(".[]()=!<> ", *p) == NULL)
+            p++;
+        if (p == name)
+            return false;
+        member->key = *keys;
+        member->length = (int) (p - name);
+        memcpy(*keys, name, member->length);
+        *keys += member->length;
+        member->hash = json_key_hash(member->key, member->length);
+        member->index = -1;
+    }
+    *members += step->members_length;
+    while (*p == ' ')
+        p++;
+    static const char *ops[] = {"==", "!=", "<=", ">=", "<", ">"};
+    static const json_path_op codes[] = {JSON_PATH_EQ, JSON_PATH_NE, JSON_PATH_LE,
+        JSON_PATH_GE, JSON_PATH_LT, JSON_PATH_GT};
+    step->op = JSON_PATH_EXISTS;
+    for (int i = 0; i < 6 && step->op == JSON_PATH_EXISTS; i++) {
+        size_t n = strlen(ops[i]);
+        if (strncmp(p, ops[i], n) == 0) {
+            step->op = codes[i];
+            p += n;
+        }
+    }
+    if (step->op != JSON_PATH_EXISTS) {
+        while (*p == ' ')
+            p++;
+        if (*p == '\'' || *p == '"') {
+            step->literal = JSON_STR;
+            if (!json_path_quoted(&p, keys, &step->key, &step->length))
+                return false;
+        } else if (strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0) {
+            step->literal = JSON_BOO;
+            step->number = *p == 't';
+            p += *p == 't' ? 4 : 5;
+        } else if (strncmp(p, "null", 4) == 0) {
+            step->literal = JSON_NUL;
+            p += 4;
+        } else {
+            int n = (int) strspn(p, "-0123456789.eE+");
+            if (n == 0 || !json_parse_double(p, n, &step->number))
+                return false;
+            step->literal = JSON_FLO;
+            p += n;
+        }
+        while (*p == ' ')
+            p++;
+    }
+    if (*p++ != ')')
+        return false;
+    *at = p;
+    return true;
+}
+
+/**
+ * Compiles path, see above. Returns NULL for anything outside the subset.
+ * Release the result with json_path_release; it does not refer back to path.
+ */
+json_path*
+json_path_compile(const char *path)
+{
+    int text = (int) strlen(path);
+    if (path[0] != '$')
+        return NULL;
+    /** Every step and filter name takes at least one byte of the text */
+    json_path *compiled = (json_path*) malloc(sizeof(json_path) +
+        sizeof(json_path_step) * text + sizeof(json_pointer_step) * text + text);
+    compiled->length = 0;
+    compiled->steps = (json_path_step*) (compiled + 1);
+    json_pointer_step *members = (json_pointer_step*) (compiled->steps + text);
+    char *keys = (char*) (members + text);
+    const char *p = path + 1;
+    while (*p != STR_END) {
+        json_path_step *step = &compiled->steps[compiled->length++];
+        memset(step, 0, sizeof(*step));
+        step->start = step->end = step->step = INT_MIN;
+        if (p[0] == '.' && p[1] == '.') {
+            step->descend = true;
+            p += 1;
+            if (p[1] == '[')
+                p++;
+        }
+        bool ok = true;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                step->kind = JSON_PATH_WILDCARD;
+                p++;
+            } else {
+                const char *name = p;
+                while (*p != STR_END && *p != '.' && *p != '[')
+                    p++;
+                step->kind = JSON_PATH_CHILD;
+                step->key = keys;
+                step->length = (int) (p - name);
+                memcpy(keys, name, step->length);
+                keys += step->length;
+                ok = step->length > 0;
+            }
+        } else if (*p == '[') {
+            p++;
+            if (*p == '*') {
+                step->kind = JSON_PATH_WILDCARD;
+                p++;
+            } else if (*p == '\'' || *p == '"') {
+                step->kind = JSON_PATH_CHILD;
+                ok = json_path_quoted(&p, &keys, &step->key, &step->length);
+            } else if (p[0] == '?' && p[1] == '(') {
+                step->kind = JSON_PATH_FILTER;
+                p += 2;
+                ok = json_path_filter(&p, step, &members, &keys);
+            } else {
+                int *parts[3] = {&step->start, &step->end, &step->step};
+                int colons = 0;
+                json_path_int(&p, parts[0]);
+                while (*p == ':' && colons < 2) {
+                    p++;
+                    colons++;
+                    json_path_int(&p, parts[colons]);
+                }
+                step->kind = colons > 0 ? JSON_PATH_SLICE : JSON_PATH_INDEX;
+                ok = colons > 0 || step->start != INT_MIN;
+            }
+            ok = ok && *p++ == ']';
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            free(compiled);
+            return NULL;
+        }
+        if (step->kind == JSON_PATH_CHILD)
+            step->hash = json_key_hash(step->key, step->length);
+    }
+    return compiled;
+}
+
+void
+json_path_release(json_path *path)
+{
+    free(path);
+}
+
+/** Whether the filter of step holds for token */
+bool
+json_path_test(json_parser *parser, json_jsontoken *token, const json_path_step *step)
+{
+    for (int i = 0; i < step->members_length && token != NULL; i++) {
+        const json_pointer_step *member = &step->members[i];
+        token = json_obj_get_hashed(parser, token, member->key, member->length, member->hash);
+    }
+    if (token == NULL || step->op == JSON_PATH_EXISTS)
+        return token != NULL;
+    int order;
+    if (step->literal == JSON_FLO) {
+        double value;
+        if (!json_token_get_double(parser, token, &value))
+            return step->op == JSON_PATH_NE;
+        order = value < step->number ? -1 : value > step->number ? 1 : 0;
+    } else if (step->literal == JSON_STR) {
+        char scratch[JSON_OBJ_KEY_MAX];
+        int length;
+        const char *text = token->type == JSON_STR ?
+            json_token_get_string_view(parser, token, &length, scratch, sizeof(scratch)) : NULL;
+        if (text == NULL)
+            return step->op == JSON_PATH_NE;
+        int common = length < step->length ? length : step->length;
+        order = memcmp(text, step->key, common);
+        if (order == 0)
+            order = length < step->length ? -1 : length > step->length ? 1 : 0;
+    } else {
+        /** true, false and null only compare for equality */
+        bool same = token->type == step->literal && (step->literal == JSON_NUL ||
+            (parser->input[token->start_in] == 't') == (step->number != 0));
+        if (step->op == JSON_PATH_EQ || step->op == JSON_PATH_NE)
+            return same == (step->op == JSON_PATH_EQ);
+        return false;
+    }
+    switch (step->op) {
+    case JSON_PATH_EQ: return order == 0;
+    case JSON_PATH_NE: return order != 0;
+    case JSON_PATH_LT: return order < 0;
+    case JSON_PATH_LE: return order <= 0;
+    case JSON_PATH_GT: return order > 0;
+    default: return order >= 0;
+    }
+}
+
+/** Child i of a container token: a member's value or an element */
+json_jsontoken*
+json_path_child(json_jsontoken *token, int i)
+{
+    json_jsontoken *child = token->children->tokens[i];
+    if (token->type != JSON_OBJ)
+        return child;
+    return child->children->length > 0 ? child->children->tokens[0] : NULL;
+}
+
+void json_path_run(json_parser *parser, json_jsontoken *token, const json_path *path, int s,
+    json_jsontoken **out, int cap, int *count);
+
+/** Applies step s to token alone, running the rest of the path on what it selects */
+void
+json_path_select(json_parser *parser, json_jsontoken *token, const json_path *path, int s,
+    json_jsontoken **out, int cap, int *count)
+{
+    const json_path_step *step = &path->steps[s];
+    bool container = token->type == JSON_OBJ || token->type == JSON_ARR;
+    int n = container ? token->children->length : 0;
+    if (step->kind == JSON_PATH_CHILD) {
+        json_jsontoken *value = json_obj_get_hashed(parser, token, step->key, step->length, step->hash);
+        if (value != NULL)
+            json_path_run(parser, value, path, s + 1, out, cap, count);
+    } else if (step->kind == JSON_PATH_WILDCARD || step->kind == JSON_PATH_FILTER) {
+        for (int i = 0; i < n; i++) {
+            json_jsontoken *child = json_path_child(token, i);
+            if (child != NULL && (step->kind == JSON_PATH_WILDCARD ||
+                json_path_test(parser, child, step)))
+                json_path_run(parser, child, path, s + 1, out, cap, count);
+        }
+    } else if (token->type == JSON_ARR && step->kind == JSON_PATH_INDEX) {
+        int i = step->start < 0 ? n + step->start : step->start;
+        if (i >= 0 && i < n)
+            json_path_run(parser, token->children->tokens[i], path, s + 1, out, cap, count);
+    } else if (token->type == JSON_ARR) {
+        /** Slice bounds as in RFC 9535 section 2.3.4.2.2 */
+        long by = step->step == INT_MIN ? 1 : step->step;
+        long start = step->start, end = step->end;
+        if (by == 0)
+            return;
+        if (start == INT_MIN)
+            start = by > 0 ? 0 : n - 1;
+        else if (start < 0)
+            start += n;
+        if (end == INT_MIN)
+            end = by > 0 ? n : -n - 1;
+        else if (end < 0)
+            end += n;
+        if (by > 0) {
+            long lower = start < 0 ? 0 : start > n ? n : start;
+            long upper = end < 0 ? 0 : end > n ? n : end;
+            for (long i = lower; i < upper; i += by)
+                json_path_run(parser, token->children->tokens[i], path, s + 1, out, cap, count);
+        } else {
+            long upper = start < -1 ? -1 : start > n - 1 ? n - 1 : start;
+            long lower = end < -1 ? -1 : end > n - 1 ? n - 1 : end;
+            for (long i = upper; lower < i; i += by)
+                json_path_run(parser, token->children->tokens[i], path, s + 1, out, cap, count);
+        }
+    }
+}
+
+/** Runs steps s onwards from token, collecting what the last one selects */
+void
+json_path_run(json_parser *parser, json_jsontoken *token, const json_path *path, int s,
+    json_jsontoken **out, int cap, int *count)
+{
+    if (s == path->length) {
+        if (*count < cap)
+            out[*count] = token;
+        (*count)++;
+        return;
+    }
+    json_path_select(parser, token, path, s, out, cap, count);
+    if (path->steps[s].descend && (token->type == JSON_OBJ || token->type == JSON_ARR)) {
+        for (int i = 0; i < token->children->length; i++) {
+            json_jsontoken *child = json_path_child(token, i);
+            if (child != NULL)
+                json_path_run(parser, child, path, s, out, cap, count);
+        }
+    }
+}
+
+/**
+ * Runs the compiled path from the value token root, storing the first cap
+ * matches in document order in out. Like json_parse_into, returns the total
+ * number of matches, so a result above cap means out was too small.
+ */
+int
+json_path_query(json_parser *parser, json_jsontoken *root, const json_path *path, json_jsontoken **out, int cap)
+{
+    int count = 0;
+    json_path_run(parser, root, path, 0, out, cap, &count);
+    return count;
+}
+
+/**
+ * On-demand cursor. Nothing is materialized until a getter asks for it:
+ * moves step over keys with the scanner json_parsestr uses, and values
+ * nobody asks for go through json_skip_value. Skipped containers are not
+ * otherwise checked, so malformed input inside them can go unnoticed, and
+ * UTF-8 is not validated.
+ */
+
+/** Next byte that is not whitespace, leaving curr on it */
+char
+json_cursor_peek(json_cursor *cursor)
+{
+    cursor->curr = json_skipws(cursor->input, cursor->curr, cursor->end);
+    return cursor->curr < cursor->end ? cursor->input[cursor->curr] : STR_END;
+}
+
+/** Marks the input malformed, returning false for the caller to pass on */
+bool
+json_cursor_fail(json_cursor *cursor)
+{
+    cursor->error = true;
+    cursor->pending = false;
+    return false;
+}
+
+/** Consumes the pending value, which is length bytes long */
+bool
+json_cursor_consume(json_cursor *cursor, int length)
+{
+    cursor->curr += length;
+    cursor->pending = false;
+    return true;
+}
+
+/** Starts a cursor before the single value of the length bytes at input */
+void
+json_cursor_init(json_cursor *cursor, const char *input, int length)
+{
+    cursor->input = input;
+    cursor->curr = 0;
+    cursor->end = length;
+    cursor->depth = 0;
+    cursor->first = true;
+    cursor->pending = false;
+    cursor->error = false;
+    if ((JSON_CLASS(json_cursor_peek(cursor)) & JSON_CLASS_VALUE) == JSON_CLASS_INVALID)
+        json_cursor_fail(cursor);
+    else
+        cursor->pending = true;
+}
+
+/**
+ * Type of the pending value, JSON_OUT when there is none. Numbers are
+ * scanned to tell JSON_INT from JSON_FLO.
+ */
+json_jsontoken_type
+json_cursor_type(json_cursor *cursor)
+{
+    if (!cursor->pending)
+        return JSON_OUT;
+    bool is_float = false;
+    switch (JSON_CLASS(cursor->input[cursor->curr]) & JSON_CLASS_VALUE) {
+        case JSON_CLASS_OBJ: return JSON_OBJ;
+        case JSON_CLASS_ARR: return JSON_ARR;
+        case JSON_CLASS_STR: return JSON_STR;
+        case JSON_CLASS_BOOL: return JSON_BOO;
+        case JSON_CLASS_NULL: return JSON_NUL;
+        case JSON_CLASS_NUM:
+            json_scannum(cursor->input, cursor->curr, cursor->end, &is_float);
+            return is_float ? JSON_FLO : JSON_INT;
+        default: return JSON_OUT;
+    }
+}
+
+/** Steps into the pending object or array; false for any other value */
+bool
+json_cursor_enter(json_cursor *cursor)
+{
+    if (!cursor->pending)
+        return false;
+    char c = cursor->input[cursor->curr];
+    if (c != '{' && c != '[')
+        return false;
+    cursor->curr++;
+    cursor->depth++;
+    cursor->first = true;
+    cursor->pending = false;
+    return true;
+}
+
+/** Skips the rest of the innermost container and steps out of it */
+bool
+json_cursor_leave(json_cursor *cursor)
+{
+    if (cursor->error || cursor->depth == 0)
+        return false;
+    if (cursor->pending && !json_cursor_skip(cursor))
+        return false;
+    int next = json_skip_brackets(cursor->input, cursor->curr, cursor->end, 1);
+    if (next < 0)
+        return json_cursor_fail(cursor);
+    cursor->curr = next;
+    cursor->depth--;
+    cursor->first = false;
+    return true;
+}
+
+/** Skips the pending value without materializing it */
+bool
+json_cursor_skip(json_cursor *cursor)
+{
+    if (!cursor->pending)
+        return false;
+    int next = json_skip_value(cursor->input, cursor->curr, cursor->end);
+    if (next < 0)
+        return json_cursor_fail(cursor);
+    cursor->curr = next;
+    cursor->pending = false;
+    return true;
+}
+
+/**
+ * Moves past the pending value and the comma after it to the next member of
+ * the innermost container. At the closing bracket close, steps out of the
+ * container and returns false, as it does on malformed input.
+ */
+bool
+json_cursor_advance(json_cursor *cursor, char close)
+{
+    if (cursor->error || cursor->depth == 0)
+        return false;
+    if (cursor->pending && !json_cursor_skip(cursor))
+        return false;
+    char c = json_cursor_peek(cursor);
+    if (c == close) {
+        cursor->curr++;
+        cursor->depth--;
+        cursor->first = false;
         return false;
     }
-    bool needs_comma = false;
-    bool err_seen = false;
-    while (1) {
-        curr_c = parser->input[parser->curr++];
-        if (json_iswhitespace(curr_c)) {
+    if (!cursor->first) {
+        if (c != ',')
+            return json_cursor_fail(cursor);
+        cursor->curr++;
+    }
+    cursor->first = false;
+    return true;
+}
+
+/** Makes the value at the next non-whitespace byte pending */
+bool
+json_cursor_value(json_cursor *cursor)
+{
+    if ((JSON_CLASS(json_cursor_peek(cursor)) & JSON_CLASS_VALUE) == JSON_CLASS_INVALID)
+        return json_cursor_fail(cursor);
+    cursor->pending = true;
+    return true;
+}
+
+/** json_cursor_next_field, also telling whether the key has escapes */
+bool
+json_cursor_field(json_cursor *cursor, const char **key, int *length, bool *escaped)
+{
+    if (!json_cursor_advance(cursor, '}'))
+        return false;
+    if (json_cursor_peek(cursor) != '"')
+        return json_cursor_fail(cursor);
+    int close = json_scanstr_close(cursor->input, cursor->curr + 1, cursor->end, escaped, NULL);
+    if (close < 0)
+        return json_cursor_fail(cursor);
+    *key = cursor->input + cursor->curr + 1;
+    *length = close - cursor->curr - 1;
+    cursor->curr = close + 1;
+    if (json_cursor_peek(cursor) != ':')
+        return json_cursor_fail(cursor);
+    cursor->curr++;
+    return json_cursor_value(cursor);
+}
+
+/**
+ * Moves to the next member of the object the cursor is in, leaving its value
+ * pending and pointing key at the key as written, escapes and all. Returns
+ * false once the object ends, stepping out of it.
+ */
+bool
+json_cursor_next_field(json_cursor *cursor, const char **key, int *length)
+{
+    bool escaped;
+    return json_cursor_field(cursor, key, length, &escaped);
+}
+
+/**
+ * Moves to the value of the next member whose key decodes to the length
+ * bytes at key, skipping the members before it. Being forward-only, fields
+ * are found fastest when asked for in document order. Returns false when no
+ * later member matches, having stepped out of the object.
+ */
+bool
+json_cursor_find_field(json_cursor *cursor, const char *key, int length)
+{
+    const char *at;
+    int raw;
+    bool escaped;
+    char scratch[JSON_OBJ_KEY_MAX];
+    while (json_cursor_field(cursor, &at, &raw, &escaped)) {
+        if (!escaped) {
+            if (raw == length && memcmp(at, key, length) == 0)
+                return true;
             continue;
-        } else if (curr_c == ']') {
-            break;
-        } else if (curr_c == STR_END) {
-            err_seen = true;
-        } else if (curr_c == ',') {
-            if (!needs_comma)
-                err_seen = true;
-            needs_comma = false;
-        } else {
-            parser->curr--;
-            if (json_isnumericalishchar(curr_c)) {
-                if (!json_parsenum(parser, arrtoken))
-                    err_seen = true;
-            } else if (curr_c == '\"') {
-                if (!json_parsestr(parser, arrtoken))
-                    err_seen = true;
-            } else if (curr_c == 'n') {
-                if (!json_parsenull(parser, arrtoken))
-                    err_seen = true;
-            } else if (curr_c == 't' || curr_c == 'f') {
-                if (!json_parsebool(parser, arrtoken))
-                    err_seen = true;
-            } else if (curr_c == '{') {
-                if (!json_parseobj(parser, arrtoken))
-                    err_seen = true;
-            } else if (curr_c == '[') {
-                if (!json_parsearr(parser, arrtoken))
-                    err_seen = true;
-            } else {
-                err_seen = true;
-            }
-            needs_comma = true;
-        }
-        if (err_seen) {
-            parent->error = true;
-            return false;
         }
+        int decoded = json_unescape(at, raw, scratch, sizeof(scratch));
+        if (decoded == length && decoded < (int) sizeof(scratch) &&
+            memcmp(scratch, key, length) == 0)
+            return true;
     }
-    json_jsontoken_list_append(
-        parent->children,
-        arrtoken
-    );
-    arrtoken->end_in = parser->curr;
+    return false;
+}
+
+/**
+ * Moves to the next element of the array the cursor is in, leaving it
+ * pending. Returns false once the array ends, stepping out of it.
+ */
+bool
+json_cursor_next_element(json_cursor *cursor)
+{
+    return json_cursor_advance(cursor, ']') && json_cursor_value(cursor);
+}
+
+/** Text of the pending number; false when the pending value is not one */
+bool
+json_cursor_number(json_cursor *cursor, const char **at, int *length)
+{
+    if (!cursor->pending ||
+        (JSON_CLASS(cursor->input[cursor->curr]) & JSON_CLASS_VALUE) != JSON_CLASS_NUM)
+        return false;
+    bool is_float;
+    int next = json_scannum(cursor->input, cursor->curr, cursor->end, &is_float);
+    if (next < 0)
+        return json_cursor_fail(cursor);
+    *at = cursor->input + cursor->curr;
+    *length = next - cursor->curr;
     return true;
 }
 
+/**
+ * Getters read the pending value and consume it. When it has another type
+ * or does not fit, they return false and leave it pending.
+ */
+
 bool
-json_parseobj(json_parser *parser, json_jsontoken *parent)
+json_cursor_get_int64(json_cursor *cursor, int64_t *out)
 {
-    json_jsontoken *objtoken = json_jsontoken_create(JSON_OBJ, parent);
-    json_jsontoken_list_append(
-        parser->all_tokens,
-        objtoken
-    );
-    objtoken->start_in = parser->curr;
-    char curr_c = parser->input[parser->curr++];
-    if (curr_c != '{') {
-        parent->error = true;
+    const char *at;
+    int length;
+    return json_cursor_number(cursor, &at, &length) &&
+        json_parse_int64(at, length, out) && json_cursor_consume(cursor, length);
+}
+
+bool
+json_cursor_get_uint64(json_cursor *cursor, uint64_t *out)
+{
+    const char *at;
+    int length;
+    return json_cursor_number(cursor, &at, &length) &&
+        json_parse_uint64(at, length, out) && json_cursor_consume(cursor, length);
+}
+
+bool
+json_cursor_get_double(json_cursor *cursor, double *out)
+{
+    const char *at;
+    int length;
+    return json_cursor_number(cursor, &at, &length) &&
+        json_parse_double(at, length, out) && json_cursor_consume(cursor, length);
+}
+
+bool
+json_cursor_get_bool(json_cursor *cursor, bool *out)
+{
+    if (!cursor->pending)
         return false;
+    const char *at = cursor->input + cursor->curr;
+    int available = cursor->end - cursor->curr;
+    if (json_match4(at, available, "true")) {
+        *out = true;
+        return json_cursor_consume(cursor, 4);
     }
-    bool is_key = true;
-    bool needs_comma = false;
-    bool err_seen = false;
-    json_jsontoken* last_key;
-    while (1) {
-        curr_c = parser->input[parser->curr++];
-        if (json_iswhitespace(curr_c))
-            continue;
-        else if (curr_c == '}')
-            break;
-        else if (curr_c == STR_END)
-            err_seen = true;
-        else if (curr_c == ':') {
-            if (!is_key)
-                err_seen = true;
-            is_key = false;
-        } else if (curr_c == ',') {
-            if (!needs_comma)
-                err_seen = true;
-            needs_comma = false;
-        } else if (is_key) {
-            parser->curr--;
-            if (!json_parsestr(parser, objtoken))
-                err_seen = true;
-            last_key = parser->all_tokens->tokens[parser->all_tokens->length - 1];
-        } else {
-            parser->curr--;
-            if (json_isnumericalishchar(curr_c)) {
-                if (!json_parsenum(parser, last_key))
-                    err_seen = true;
-            } else if (curr_c == '\"') {
-                if (!json_parsestr(parser, last_key))
-                    err_seen = true;
-            } else if (curr_c == 'n') {
-                if (!json_parsenull(parser, last_key))
-                    err_seen = true;
-            } else if (curr_c == 't' || curr_c == 'f') {
-                if (!json_parsebool(parser, last_key))
-                    err_seen = true;
-            } else if (curr_c == '{') {
-                if (!json_parseobj(parser, last_key))
-                    err_seen = true;
-            } else if (curr_c == '[') {
-                if (!json_parsearr(parser, last_key))
-                    err_seen = true;
-            } else {
-                err_seen = true;
-            }
-            is_key = true;
-            needs_comma = true;
+    if (at[0] == 'f' && json_match4(at + 1, available - 1, "alse")) {
+        *out = false;
+        return json_cursor_consume(cursor, 5);
+    }
+    return false;
+}
+
+/** Consumes the pending value if it is null */
+bool
+json_cursor_get_null(json_cursor *cursor)
+{
+    return cursor->pending &&
+        json_match4(cursor->input + cursor->curr, cursor->end - cursor->curr, "null") &&
+        json_cursor_consume(cursor, 4);
+}
+
+/** Body of the pending string; false when the pending value is not one */
+bool
+json_cursor_string(json_cursor *cursor, const char **at, int *length, bool *escaped)
+{
+    if (!cursor->pending || cursor->input[cursor->curr] != '"')
+        return false;
+    int close = json_scanstr_close(cursor->input, cursor->curr + 1, cursor->end, escaped, NULL);
+    if (close < 0)
+        return json_cursor_fail(cursor);
+    *at = cursor->input + cursor->curr + 1;
+    *length = close - cursor->curr - 1;
+    return true;
+}
+
+/**
+ * Decoded text of the pending string, see json_unescape; -1 for any other
+ * value. The string is consumed only when it fit in out.
+ */
+int
+json_cursor_get_string(json_cursor *cursor, char *out, int cap)
+{
+    const char *at;
+    int raw;
+    bool escaped;
+    if (!json_cursor_string(cursor, &at, &raw, &escaped))
+        return -1;
+    int decoded = json_unescape(at, raw, out, cap);
+    if (decoded >= 0 && decoded < cap)
+        json_cursor_consume(cursor, raw + 2);
+    return decoded;
+}
+
+/**
+ * Decoded text of the pending string without copying when it has no
+ * escapes, with the results of json_token_get_string_view. The string is
+ * consumed only when the text is returned.
+ */
+const char*
+json_cursor_get_string_view(json_cursor *cursor, int *length, char *scratch, int cap)
+{
+    const char *at;
+    int raw;
+    bool escaped;
+    *length = -1;
+    if (!json_cursor_string(cursor, &at, &raw, &escaped))
+        return NULL;
+    const char *text = at;
+    *length = raw;
+    if (escaped) {
+        int decoded = json_unescape(at, raw, scratch, cap);
+        if (decoded < 0) {
+            *length = -1;
+            return NULL;
         }
-        if (err_seen) {
-            parent->error = true;
-            return false;
+        if (decoded >= cap) {
+            *length = decoded + 1;
+            return NULL;
+        }
+        text = scratch;
+        *length = decoded;
+    }
+    json_cursor_consume(cursor, raw + 2);
+    return text;
+}
+
+/**
+ * Field projection. The paths are JSON Pointers in which a step of exactly
+ * "*" matches every member or element. They are compiled into one trie
+ * whose wildcard subtrees are copied under their named siblings, so the
+ * parser follows a single node per value: a member or element with no node
+ * is skipped with json_skip_value and leaves no tokens, ancestors of the
+ * paths keep only the tokens leading to them, and values the paths end at
+ * are parsed whole.
+ */
+
+/** Child of parent with the given step, added when there is none */
+int
+json_projection_add(json_projection *projection, int parent, const char *key, int length, int index)
+{
+    if (parent >= 0) {
+        for (int c = projection->nodes[parent].child; c >= 0; c = projection->nodes[c].next) {
+            const json_projection_node *n = &projection->nodes[c];
+            if (key == NULL ? n->key == NULL :
+                n->key != NULL && n->length == length && memcmp(n->key, key, length) == 0)
+                return c;
+        }
+    }
+    if (projection->length == projection->capacity) {
+        projection->capacity = projection->capacity == 0 ? JSON_JSONTOKEN_LIST_START_CAP :
+            JSON_JSONTOKEN_LIST_EXPANSION(projection->capacity);
+        projection->nodes = (json_projection_node*) realloc(projection->nodes,
+            sizeof(json_projection_node) * projection->capacity);
+    }
+    int added = projection->length++;
+    json_projection_node *node = &projection->nodes[added];
+    node->key = key;
+    node->length = length;
+    node->index = index;
+    node->child = -1;
+    node->next = -1;
+    node->keep = false;
+    if (parent >= 0) {
+        node->next = projection->nodes[parent].child;
+        projection->nodes[parent].child = added;
+    }
+    return added;
+}
+
+/** Copies the subtree under from into the subtree under to */
+void
+json_projection_merge(json_projection *projection, int to, int from)
+{
+    if (projection->nodes[from].keep)
+        projection->nodes[to].keep = true;
+    for (int c = projection->nodes[from].child; c >= 0; c = projection->nodes[c].next) {
+        json_projection_node step = projection->nodes[c];
+        json_projection_merge(projection,
+            json_projection_add(projection, to, step.key, step.length, step.index), c);
+    }
+}
+
+/** Copies each wildcard subtree under its named siblings, from node down */
+void
+json_projection_expand(json_projection *projection, int node)
+{
+    int wildcard = -1;
+    for (int c = projection->nodes[node].child; c >= 0; c = projection->nodes[c].next)
+        if (projection->nodes[c].key == NULL)
+            wildcard = c;
+    if (wildcard >= 0) {
+        for (int c = projection->nodes[node].child; c >= 0; c = projection->nodes[c].next)
+            if (c != wildcard)
+                json_projection_merge(projection, c, wildcard);
+    }
+    for (int c = projection->nodes[node].child; c >= 0; c = projection->nodes[c].next)
+        json_projection_expand(projection, c);
+}
+
+/**
+ * Compiles count paths into one projection for json_parser_project, or
+ * returns NULL when a path is not a valid JSON Pointer. The empty path keeps
+ * the whole document. Release with json_projection_release.
+ */
+json_projection*
+json_projection_compile(const char **paths, int count)
+{
+    json_projection *projection = (json_projection*) malloc(sizeof(json_projection));
+    projection->length = 0;
+    projection->capacity = 0;
+    projection->nodes = NULL;
+    projection->pointers = (json_pointer**) malloc(sizeof(json_pointer*) * (count > 0 ? count : 1));
+    projection->pointers_length = 0;
+    json_projection_add(projection, -1, NULL, 0, -1);
+    for (int i = 0; i < count; i++) {
+        json_pointer *pointer = json_pointer_compile(paths[i]);
+        if (pointer == NULL) {
+            json_projection_release(projection);
+            return NULL;
         }
+        projection->pointers[projection->pointers_length++] = pointer;
+        int node = 0;
+        for (int s = 0; s < pointer->length; s++) {
+            const json_pointer_step *step = &pointer->steps[s];
+            bool wildcard = step->length == 1 && step->key[0] == '*';
+            node = json_projection_add(projection, node,
+                wildcard ? NULL : step->key, step->length, wildcard ? -1 : step->index);
+        }
+        projection->nodes[node].keep = true;
+    }
+    json_projection_expand(projection, 0);
+    return projection;
+}
+
+void
+json_projection_release(json_projection *projection)
+{
+    for (int i = 0; i < projection->pointers_length; i++)
+        json_pointer_release(projection->pointers[i]);
+    free(projection->pointers);
+    free(projection->nodes);
+    free(projection);
+}
+
+/**
+ * Child of node that an object member with the length byte key falls under,
+ * the wildcard when no step names it, or -1. escaped tells whether key is
+ * written with escapes, which are decoded before comparing.
+ */
+int
+json_projection_key(const json_projection *projection, int node, const char *key, int length, bool escaped)
+{
+    char scratch[JSON_OBJ_KEY_MAX];
+    if (escaped) {
+        int decoded = json_unescape(key, length, scratch, sizeof(scratch));
+        /** Too long or malformed to decode, so only a wildcard matches */
+        length = decoded >= 0 && decoded < (int) sizeof(scratch) ? decoded : -1;
+        key = scratch;
+    }
+    int wildcard = -1;
+    for (int c = projection->nodes[node].child; c >= 0; c = projection->nodes[c].next) {
+        const json_projection_node *n = &projection->nodes[c];
+        if (n->key == NULL)
+            wildcard = c;
+        else if (n->length == length && memcmp(n->key, key, length) == 0)
+            return c;
+    }
+    return wildcard;
+}
+
+/** Child of node that array element number element falls under, or -1 */
+int
+json_projection_element(const json_projection *projection, int node, int element)
+{
+    int wildcard = -1;
+    for (int c = projection->nodes[node].child; c >= 0; c = projection->nodes[c].next) {
+        const json_projection_node *n = &projection->nodes[c];
+        if (n->key == NULL)
+            wildcard = c;
+        else if (n->index == element)
+            return c;
+    }
+    return wildcard;
+}
+
+/**
+ * Makes json_parsevalue create tokens only along the paths of projection,
+ * from the next parse on and after every reset, or for everything again
+ * when it is NULL. Skipped array elements leave no token, so the kept ones
+ * are numbered among themselves: an array index in a JSON Pointer or JSONPath
+ * run on the projected tree counts kept elements, not those of the source
+ * document. The projection must outlive its use; json_parse_indexed fails
+ * while one is set.
+ */
+void
+json_parser_project(json_parser *parser, const json_projection *projection)
+{
+    parser->projection = projection;
+    parser->projection_node = projection != NULL ? 0 : -1;
+}
+
+/** Node the value about to be parsed falls under, -1 when all of it is kept */
+int
+json_parser_projection_active(const json_parser *parser)
+{
+    int node = parser->projection_node;
+    return node >= 0 && !parser->projection->nodes[node].keep ? node : -1;
+}
+
+/**
+ * Looks up the object member whose key starts at parser->curr under node.
+ * When its value falls under a child, sets *child to it and leaves the
+ * member to be parsed. Otherwise skips the whole member and sets *child to
+ * -1. Returns false on malformed input.
+ */
+bool
+json_parser_project_member(json_parser *parser, int node, int *child)
+{
+    const char *input = parser->input;
+    bool escaped;
+    if (JSON_PEEK(parser, parser->curr) != '"')
+        return false;
+    int close = json_scanstr_close(input, parser->curr + 1, parser->end, &escaped, NULL);
+    if (close < 0)
+        return false;
+    *child = json_projection_key(parser->projection, node,
+        input + parser->curr + 1, close - parser->curr - 1, escaped);
+    if (*child >= 0)
+        return true;
+    int pos = json_skipws(input, close + 1, parser->end);
+    if (pos >= parser->end || input[pos] != ':')
+        return false;
+    pos = json_skip_value(input, pos + 1, parser->end);
+    if (pos < 0)
+        return false;
+    parser->curr = pos;
+    return true;
+}
+
+/**
+ * Shallow parsing. Past the level set by json_parser_shallow, containers are
+ * skipped with json_skip_value and left as tokens that only record their
+ * span; json_expand parses one later, in place. Marks live in the parser,
+ * indexed by token, so tokens stay the same size.
+ */
+
+/**
+ * Makes every later parse build tokens for the top levels of containers
+ * only, the root container being level 1, or for everything with 0.
+ * Containers below are left unexpanded: they have their type and span but
+ * no children until json_expand. json_parse_indexed fails while this is
+ * set.
+ */
+void
+json_parser_shallow(json_parser *parser, int levels)
+{
+    parser->shallow = levels;
+}
+
+/**
+ * Skips the container at parser->curr and leaves token, which is open, with
+ * its span and no children, marked for json_expand.
+ */
+bool
+json_parser_defer(json_parser *parser, json_jsontoken *token, json_jsontoken *parent)
+{
+    int end = json_skip_value(parser->input, parser->curr, parser->end);
+    if (end < 0) {
+        parent->error = true;
+        return false;
+    }
+    if (token->index >= parser->lazy_length) {
+        int length = parser->lazy_length == 0 ? parser->all_tokens->capacity :
+            JSON_JSONTOKEN_LIST_EXPANSION(parser->lazy_length);
+        if (length <= token->index)
+            length = token->index + 1;
+        parser->lazy = parser->lazy == NULL ?
+            (unsigned char*) json_parser_alloc(parser, length) :
+            (unsigned char*) json_parser_resize(parser, parser->lazy, parser->lazy_length, length);
+        memset(parser->lazy + parser->lazy_length, 0, length - parser->lazy_length);
+        parser->lazy_length = length;
     }
-    json_jsontoken_list_append(
+    parser->lazy[token->index] = 1;
+    parser->curr = end;
+    json_parser_list_append(
+        parser,
         parent->children,
-        objtoken
+        token
     );
-    objtoken->end_in = parser->curr;
+    token->end_in = end;
+    json_parser_token_close(parser, token);
     return true;
 }
 
-void
-json_parser_cleanup(json_parser *parser)
+/** True for a container a shallow parse left for json_expand */
+bool
+json_token_is_lazy(const json_parser *parser, const json_jsontoken *token)
 {
-    /** Each token has several blocks of memory allocated:
-        - the childrens' token list container
-        - the childrens' token list struct
-        - the token itself
-    */
-    for (int i = 0; i < parser->all_tokens->length; i++) {
-        json_jsontoken *token = parser->all_tokens->tokens[i];
-        free(token->children->tokens);
-        free(token->children);
-        free(token);
+    return token->index < parser->lazy_length && parser->lazy[token->index];
+}
+
+/**
+ * Parses the contents of a container left unexpanded by a shallow parse,
+ * giving it the children a full parse would have, with containers deeper
+ * than the shallow limit, counted from token, unexpanded again. The new
+ * tokens are appended to all_tokens, after every token already there.
+ * Returns true, doing nothing, for a token that is not lazy, and false on
+ * malformed input, which also sets token->error, and for a parser with a
+ * tape, whose entries must stay in document order. A failed expansion
+ * drops the tokens it made and leaves token lazy, so trying again fails
+ * again.
+ */
+bool
+json_expand(json_parser *parser, json_jsontoken *token)
+{
+    if (!json_token_is_lazy(parser, token))
+        return true;
+    if (parser->tape != NULL)
+        return false;
+    int length = parser->all_tokens->length;
+    int curr = parser->curr;
+    int depth = parser->depth;
+    int node = parser->projection_node;
+    int checked = parser->utf8_checked;
+    parser->curr = token->start_in;
+    parser->depth = 1;
+    parser->projection_node = -1;
+    /** The UTF-8 watermark may have jumped past the span while it was deferred */
+    parser->utf8_checked = token->start_in;
+    bool ok = token->type == JSON_OBJ ?
+        json_parseobj_members(parser, token) :
+        json_parsearr_members(parser, token);
+    parser->curr = curr;
+    parser->depth = depth;
+    parser->projection_node = node;
+    parser->utf8_checked = checked;
+    if (ok) {
+        parser->lazy[token->index] = 0;
+        return true;
     }
-    /** Parser follows the same pattern. */
-    free(parser->all_tokens->tokens);
-    free(parser->all_tokens);
-    free(parser);
+    for (int i = length; i < parser->all_tokens->length && i < parser->lazy_length; i++)
+        parser->lazy[i] = 0;
+    /** Heap tokens past the kept length are recycled by the next parse */
+    if (parser->arena == NULL && parser->all_tokens->length > parser->retained)
+        parser->retained = parser->all_tokens->length;
+    parser->all_tokens->length = length;
+    if (parser->columns != NULL && parser->columns->length > length)
+        parser->columns->length = length;
+    token->children->length = 0;
+    token->error = true;
+    return false;
 }
 
 #ifdef __cplusplus
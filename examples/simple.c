@@ -53,6 +53,11 @@ int main()
     for (int j = datkey->start_in; j < datkey->end_in; j++)
         printf("%c", p->input[j]);
     printf("\n");
+
+    /* Deeper values are easier to reach with a JSON Pointer */
+    json_jsontoken *title = json_pointer_get(p, obj, "/data/children/0/data/title");
+    if (title != NULL)
+        printf("%.*s\n", title->end_in - title->start_in, p->input + title->start_in);
     json_parser_cleanup(p);
     free(reddit);
 }
\ No newline at end of file
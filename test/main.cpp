@@ -1,6 +1,12 @@
 #define CATCH_CONFIG_MAIN
 #include "extern/catch.hpp"
 
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "../cjson.h"
 
 #define JSON_DUMMY_TOKEN() \
@@ -218,3 +224,1879 @@ TEST_CASE( "json_parseobj", "[json_parseobj]")
     REQUIRE( t->children->tokens[2]->children->tokens[0]->end_in == 61 );
     json_parser_cleanup(p);
 }
+
+TEST_CASE( "json_parser_create_arena", "[json_parser_create_arena]" )
+{
+    char *arr_str = "[ \"hello\", 1234, {\"a\": [true, null]} ]";
+    json_parser *p = json_parser_create_arena(arr_str);
+    REQUIRE( p->arena != NULL );
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken *t = p->all_tokens->tokens[1];
+    REQUIRE( t->children->length == 3 );
+    REQUIRE( t->children->tokens[0]->type == JSON_STR );
+    REQUIRE( t->children->tokens[1]->type == JSON_INT );
+    REQUIRE( t->children->tokens[2]->type == JSON_OBJ );
+    json_jsontoken *key = t->children->tokens[2]->children->tokens[0];
+    REQUIRE( key->start_in == 19 );
+    REQUIRE( key->end_in == 20 );
+    REQUIRE( key->children->tokens[0]->children->length == 2 );
+    REQUIRE( key->children->tokens[0]->children->tokens[1]->type == JSON_NUL );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_arena_alloc_chunks", "[json_arena_alloc]" )
+{
+    /** Enough elements to spill tokens and the array's child list
+        across several chunks */
+    int n = 20000;
+    char *arr_str = (char*) malloc(n * 2 + 2);
+    arr_str[0] = '[';
+    for (int i = 0; i < n; i++) {
+        arr_str[1 + i * 2] = '1';
+        arr_str[2 + i * 2] = i == n - 1 ? ']' : ',';
+    }
+    arr_str[n * 2 + 1] = '\0';
+    json_parser *p = json_parser_create_arena(arr_str);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->arena->next != NULL );
+    json_jsontoken *t = p->all_tokens->tokens[1];
+    REQUIRE( t->children->length == n );
+    REQUIRE( t->children->tokens[n - 1]->start_in == n * 2 - 1 );
+    json_parser_cleanup(p);
+    free(arr_str);
+}
+
+TEST_CASE( "json_parser_enable_tape", "[json_tape]" )
+{
+    char *obj_str = "{\"a\": [1, 2.5], \"b\": {\"c\": null}, \"d\": \"x\"}";
+    json_parser *p = json_parser_create(obj_str);
+    json_parser_enable_tape(p);
+    REQUIRE( json_parseobj(p, p->all_tokens->tokens[0]) == true );
+    json_tape *tape = p->tape;
+    REQUIRE( tape->length == p->all_tokens->length );
+    for (int i = 0; i < tape->length; i++) {
+        json_jsontoken *t = p->all_tokens->tokens[i];
+        REQUIRE( t->index == i );
+        REQUIRE( json_tape_type(&tape->entries[i]) == t->type );
+        if (i > 0) {
+            REQUIRE( (int) tape->entries[i].start_in == t->start_in );
+            REQUIRE( json_tape_end(&tape->entries[i]) == t->end_in );
+        }
+    }
+    /** obj, "a", [, 1, 2.5, "b", {, "c", null, "d", "x" */
+    REQUIRE( json_tape_type(&tape->entries[1]) == JSON_OBJ );
+    REQUIRE( json_tape_next(&tape->entries[1]) == 12 );
+    REQUIRE( json_tape_next(&tape->entries[2]) == 6 );
+    REQUIRE( json_tape_type(&tape->entries[4]) == JSON_INT );
+    REQUIRE( json_tape_type(&tape->entries[5]) == JSON_FLO );
+    REQUIRE( json_tape_next(&tape->entries[6]) == 10 );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_tape_child", "[json_tape]" )
+{
+    char *arr_str = "[[1, [2, 3]], {}, \"s\", [4]]";
+    json_parser *p = json_parser_create(arr_str);
+    json_parser_enable_tape(p);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    json_tape *tape = p->tape;
+    int arr = json_tape_child(tape, 0);
+    REQUIRE( arr == 1 );
+    REQUIRE( json_tape_sibling(tape, 0, arr) == -1 );
+    json_jsontoken_type expected[] = {JSON_ARR, JSON_OBJ, JSON_STR, JSON_ARR};
+    int n = 0;
+    for (int c = json_tape_child(tape, arr); c != -1; c = json_tape_sibling(tape, arr, c))
+        REQUIRE( json_tape_type(&tape->entries[c]) == expected[n++] );
+    REQUIRE( n == 4 );
+    /** Empty containers and scalars have no children */
+    int obj = json_tape_next(&tape->entries[json_tape_child(tape, arr)]);
+    REQUIRE( json_tape_child(tape, obj) == -1 );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_parse_into", "[json_parse_into]" )
+{
+    char *obj_str = " {\"a\": [1, 2.5], \"b\": {\"c\": null}, \"d\": \"x\"} ";
+    json_tape_entry entries[16];
+    int count = 0;
+    REQUIRE( json_parse_into(obj_str, entries, 16, &count) == JSON_OK );
+    REQUIRE( count == 12 );
+    REQUIRE( json_tape_type(&entries[0]) == JSON_OUT );
+    REQUIRE( json_tape_next(&entries[0]) == 12 );
+    REQUIRE( json_tape_type(&entries[1]) == JSON_OBJ );
+    REQUIRE( entries[1].start_in == 1u );
+    REQUIRE( json_tape_next(&entries[1]) == 12 );
+    REQUIRE( json_tape_type(&entries[2]) == JSON_STR );
+    REQUIRE( entries[2].start_in == 3u );
+    REQUIRE( json_tape_next(&entries[2]) == 6 );
+    REQUIRE( json_tape_type(&entries[5]) == JSON_FLO );
+    REQUIRE( json_tape_type(&entries[9]) == JSON_NUL );
+    REQUIRE( entries[11].start_in == 41u );
+    REQUIRE( json_tape_end(&entries[11]) == 42 );
+}
+
+TEST_CASE( "json_parse_into_nospace", "[json_parse_into]" )
+{
+    char *arr_str = "[1, 2, 3, [4, 5]]";
+    json_tape_entry entries[8];
+    int count = 0;
+    REQUIRE( json_parse_into(arr_str, entries, 4, &count) == JSON_NOSPACE );
+    REQUIRE( count == 8 );
+    REQUIRE( json_parse_into(arr_str, entries, count, &count) == JSON_OK );
+    REQUIRE( count == 8 );
+    REQUIRE( json_tape_type(&entries[5]) == JSON_ARR );
+    REQUIRE( json_tape_next(&entries[5]) == 8 );
+}
+
+TEST_CASE( "json_parse_into_invalid", "[json_parse_into]" )
+{
+    json_tape_entry entries[8];
+    int count = 0;
+    REQUIRE( json_parse_into((char*) "[1, 2", entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into((char*) "{\"a\": tru}", entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into((char*) "[] []", entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into((char*) "42", entries, 8, &count) == JSON_OK );
+    REQUIRE( json_tape_type(&entries[1]) == JSON_INT );
+    REQUIRE( json_tape_end(&entries[1]) == 2 );
+
+    int depth = JSON_TAPE_MAX_DEPTH;
+    char *deep = (char*) malloc(depth * 2 + 1);
+    for (int i = 0; i < depth; i++) {
+        deep[i] = '[';
+        deep[depth + i] = ']';
+    }
+    deep[depth * 2] = '\0';
+    REQUIRE( json_parse_into(deep, entries, 8, &count) == JSON_TOO_DEEP );
+    deep[depth * 2 - 1] = '\0';
+    REQUIRE( json_parse_into(deep, entries, 8, &count) == JSON_INVALID );
+    deep[0] = ' ';
+    REQUIRE( json_parse_into(deep, entries, 8, &count) == JSON_NOSPACE );
+    REQUIRE( count == depth );
+
+    /** Depth 511 fits, 512 is refused as too deep though the tree parser takes it */
+    std::vector<json_tape_entry> all(depth + 1);
+    REQUIRE( json_parse_into(deep, all.data(), depth, &count) == JSON_OK );
+    REQUIRE( count == depth );
+    deep[0] = '[';
+    deep[depth * 2 - 1] = ']';
+    REQUIRE( json_parse_into(deep, all.data(), depth + 1, &count) == JSON_TOO_DEEP );
+    json_parser *p = json_parser_create(deep);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    json_parser_cleanup(p);
+    free(deep);
+}
+
+TEST_CASE( "json_parser_reset", "[json_parser_reset]" )
+{
+    char *first = "[1, [2, 3], {\"a\": null}]";
+    char *second = "{\"b\": \"x\"}";
+    json_parser *p = json_parser_create(first);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->all_tokens->length == 9 );
+    json_jsontoken *reused = p->all_tokens->tokens[2];
+    json_parser_reset(p, second);
+    REQUIRE( p->retained == 9 );
+    REQUIRE( p->all_tokens->length == 1 );
+    REQUIRE( p->all_tokens->tokens[0]->children->length == 0 );
+    REQUIRE( json_parseobj(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->all_tokens->length == 4 );
+    REQUIRE( p->all_tokens->tokens[2] == reused );
+    json_jsontoken *obj = p->all_tokens->tokens[1];
+    REQUIRE( obj->type == JSON_OBJ );
+    REQUIRE( obj->parent == p->all_tokens->tokens[0] );
+    REQUIRE( obj->children->length == 1 );
+    REQUIRE( obj->children->tokens[0]->children->tokens[0]->start_in == 7 );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_parser_reset_arena", "[json_parser_reset]" )
+{
+    int n = 20000;
+    char *arr_str = (char*) malloc(n * 2 + 2);
+    arr_str[0] = '[';
+    for (int i = 0; i < n; i++) {
+        arr_str[1 + i * 2] = '1';
+        arr_str[2 + i * 2] = i == n - 1 ? ']' : ',';
+    }
+    arr_str[n * 2 + 1] = '\0';
+    json_parser *p = json_parser_create_arena(arr_str);
+    json_parser_enable_tape(p);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->arena->next != NULL );
+    json_parser_reset(p, arr_str);
+    REQUIRE( p->arena->next == NULL );
+    REQUIRE( p->tape->length == 1 );
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->arena->next == NULL );
+    REQUIRE( p->all_tokens->tokens[1]->children->length == n );
+    REQUIRE( json_tape_next(&p->tape->entries[1]) == n + 2 );
+    json_parser_cleanup(p);
+    free(arr_str);
+}
+
+TEST_CASE( "json_tape_entry_packed", "[json_tape]" )
+{
+    REQUIRE( sizeof(json_tape_entry) == 16 );
+    char *obj_str = "{\"a\": [1, {\"b\": true}]}";
+    json_tape_entry entries[8];
+    int count = 0;
+    REQUIRE( json_parse_into(obj_str, entries, 8, &count) == JSON_OK );
+    /** wrapper, obj, "a", [, 1, {, "b", true */
+    REQUIRE( count == 8 );
+    REQUIRE( entries[1].parent == 0u );
+    REQUIRE( entries[2].parent == 1u );
+    REQUIRE( entries[3].parent == 2u );
+    REQUIRE( entries[5].parent == 3u );
+    REQUIRE( entries[7].parent == 6u );
+    REQUIRE( json_tape_type(&entries[7]) == JSON_BOO );
+    REQUIRE( entries[7].length == 4u );
+    REQUIRE( json_tape_next(&entries[3]) == 8 );
+}
+
+TEST_CASE( "json_parser_enable_columns", "[json_columns]" )
+{
+    char *obj_str = "{\"a\": [1, 2.5, \"s\"], \"b\": null}";
+    json_parser *p = json_parser_create(obj_str);
+    json_parser_enable_columns(p);
+    REQUIRE( json_parseobj(p, p->all_tokens->tokens[0]) == true );
+    json_columns *c = p->columns;
+    REQUIRE( c->length == p->all_tokens->length );
+    for (int i = 0; i < c->length; i++) {
+        json_jsontoken *t = p->all_tokens->tokens[i];
+        REQUIRE( c->types[i] == t->type );
+        REQUIRE( c->parent[i] == (t->parent == NULL ? -1 : t->parent->index) );
+        if (i > 0) {
+            REQUIRE( c->start_in[i] == t->start_in );
+            REQUIRE( c->end_in[i] == t->end_in );
+        }
+    }
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_columns_find", "[json_columns]" )
+{
+    char *arr_str = "[\"x\", 1, \"y\", [\"z\"], 2]";
+    json_parser *p = json_parser_create(arr_str);
+    json_parser_enable_columns(p);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    int found[3];
+    int n = 0;
+    for (int i = json_columns_find(p->columns, JSON_STR, 0); i != -1;
+         i = json_columns_find(p->columns, JSON_STR, i + 1))
+        found[n++] = i;
+    REQUIRE( n == 3 );
+    REQUIRE( found[0] == 2 );
+    REQUIRE( found[1] == 4 );
+    REQUIRE( found[2] == 6 );
+    REQUIRE( json_columns_count(p->columns, JSON_INT) == 2 );
+    REQUIRE( json_columns_count(p->columns, JSON_ARR) == 2 );
+    REQUIRE( json_columns_find(p->columns, JSON_OBJ, 0) == -1 );
+    json_parser_cleanup(p);
+}
+
+struct counting_ctx {
+    int allocs;
+    int releases;
+    long live;
+};
+
+static void* counting_alloc(void *ctx, size_t size)
+{
+    counting_ctx *c = (counting_ctx*) ctx;
+    c->allocs++;
+    c->live += size;
+    return malloc(size);
+}
+
+static void* counting_resize(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    counting_ctx *c = (counting_ctx*) ctx;
+    c->live += (long) new_size - (long) old_size;
+    return realloc(ptr, new_size);
+}
+
+static void counting_release(void *ctx, void *ptr, size_t size)
+{
+    counting_ctx *c = (counting_ctx*) ctx;
+    c->releases++;
+    c->live -= size;
+    free(ptr);
+}
+
+TEST_CASE( "json_parser_create_with", "[json_allocator]" )
+{
+    char *arr_str = "[1, \"two\", {\"three\": [3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3]}]";
+    for (int use_arena = 0; use_arena < 2; use_arena++) {
+        counting_ctx ctx = {0, 0, 0};
+        json_allocator allocator = {counting_alloc, counting_resize, counting_release, &ctx};
+        json_parser *p = json_parser_create_with(arr_str, &allocator, use_arena);
+        REQUIRE( (p->arena != NULL) == use_arena );
+        json_parser_enable_tape(p);
+        json_parser_enable_columns(p);
+        REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+        REQUIRE( ctx.allocs > 0 );
+        json_parser_reset(p, arr_str);
+        REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+        REQUIRE( p->all_tokens->tokens[1]->children->length == 3 );
+        json_parser_cleanup(p);
+        /** Every block went back with the size it was handed out at */
+        REQUIRE( ctx.allocs == ctx.releases );
+        REQUIRE( ctx.live == 0 );
+    }
+}
+
+TEST_CASE( "json_parser_presize", "[json_parser_presize]" )
+{
+    char *obj_str = "{\"a\": [1, 2, 3, [], {\"x\": \"a\\\\\\\"]\"}], \"b\": {\"c\": null, \"d\": true},"
+        " \"e\": \"}\", \"f\": [[[-1.5e3]]]}";
+    for (int use_arena = 0; use_arena < 2; use_arena++) {
+        json_parser *p = use_arena ?
+            json_parser_create_arena(obj_str) :
+            json_parser_create(obj_str);
+        json_parser_enable_tape(p);
+        REQUIRE( json_parser_presize(p) == true );
+        int expected = p->child_counts_length;
+        REQUIRE( json_parseobj(p, p->all_tokens->tokens[0]) == true );
+        REQUIRE( p->all_tokens->length == expected );
+        REQUIRE( p->all_tokens->capacity == expected );
+        for (int i = 1; i < p->all_tokens->length; i++) {
+            json_jsontoken_list *children = p->all_tokens->tokens[i]->children;
+            REQUIRE( p->child_counts[i] == children->length );
+            if (children->length > 0)
+                REQUIRE( children->capacity == children->length );
+        }
+        json_parser_cleanup(p);
+    }
+}
+
+TEST_CASE( "json_parser_presize_unbalanced", "[json_parser_presize]" )
+{
+    char *arr_str = "[1, [2, 3]";
+    json_parser *p = json_parser_create(arr_str);
+    REQUIRE( json_parser_presize(p) == false );
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == false );
+    json_parser_reset(p, (char*) "[1]]");
+    REQUIRE( json_parser_presize(p) == false );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_skipws", "[json_skipws]" )
+{
+    REQUIRE( json_skipws("abc", 0, 3) == 0 );
+    REQUIRE( json_skipws("", 0, 0) == 0 );
+    REQUIRE( json_skipws(" \t\r\n\v\f x", 0, 8) == 7 );
+    REQUIRE( json_skipws("x   ", 1, 4) == 4 );
+    REQUIRE( json_skipws("    ", 0, 2) == 2 );
+    /** Runs longer than a vector, ending at every offset within one */
+    char buf[128];
+    for (int run = 0; run < 100; run++) {
+        memset(buf, ' ', run);
+        buf[run] = '1';
+        buf[run + 1] = STR_END;
+        REQUIRE( json_skipws(buf, 0, run + 1) == run );
+        buf[run] = ' ';
+        REQUIRE( json_skipws(buf, 0, run) == run );
+    }
+    /** Bytes next to the whitespace range are not whitespace */
+    char edges[] = {0x08, 0x0e, 0x1f, 0x21, (char) 0x89, (char) 0xa0};
+    for (size_t i = 0; i < sizeof(edges); i++) {
+        memset(buf, '\n', 40);
+        buf[35] = edges[i];
+        buf[40] = STR_END;
+        REQUIRE( json_skipws(buf, 0, 40) == 35 );
+    }
+}
+
+TEST_CASE( "json_parse_pretty", "[json_skipws]" )
+{
+    char *pretty = "{\n    \"a\": [\n        1,\n        2\n    ],\n"
+        "    \"b\"   :\t{  }  \r\n}\n\n";
+    json_parser *p = json_parser_create(pretty);
+    REQUIRE( json_parseobj(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken *obj = p->all_tokens->tokens[1];
+    REQUIRE( obj->children->length == 2 );
+    REQUIRE( obj->children->tokens[0]->children->tokens[0]->children->length == 2 );
+    REQUIRE( obj->children->tokens[1]->children->tokens[0]->type == JSON_OBJ );
+    json_parser_cleanup(p);
+    int count = 0;
+    REQUIRE( json_parse_into(pretty, NULL, 0, &count) == JSON_NOSPACE );
+    REQUIRE( count == 8 );
+}
+
+TEST_CASE( "json_scanstr", "[json_scanstr]" )
+{
+    REQUIRE( json_scanstr("\"", 0, 1) == 0 );
+    REQUIRE( json_scanstr("abc\\\"d\"", 0, 7) == 3 );
+    REQUIRE( json_scanstr("abc", 0, 3) == 3 );
+    REQUIRE( json_scanstr("abc\"", 0, 2) == 2 );
+    /** Each stop byte is found at every offset across two vectors */
+    char buf[80];
+    const char stops[] = {'"', '\\', STR_END};
+    for (int s = 0; s < 3; s++) {
+        for (int at = 0; at < 70; at++) {
+            memset(buf, 'x', sizeof(buf) - 1);
+            buf[sizeof(buf) - 1] = STR_END;
+            buf[at] = stops[s];
+            REQUIRE( json_scanstr(buf, 0, sizeof(buf) - 1) == at );
+        }
+    }
+}
+
+TEST_CASE( "json_parsestr_long", "[json_scanstr]" )
+{
+    /** Escapes land on either side of vector boundaries */
+    std::string body;
+    for (int i = 0; i < 200; i++) {
+        body += std::string(i % 37, 'a');
+        body += i % 3 ? "\\\"" : "\\\\";
+    }
+    std::string doc = "[\"" + body + "\", \"\\\\\", \"x\\\"\"]";
+    json_parser *p = json_parser_create((char*) doc.c_str());
+    json_parser_enable_tape(p);
+    REQUIRE( json_parser_presize(p) == true );
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken *arr = p->all_tokens->tokens[1];
+    REQUIRE( arr->children->length == 3 );
+    REQUIRE( arr->children->tokens[0]->start_in == 2 );
+    REQUIRE( arr->children->tokens[0]->end_in == 2 + (int) body.size() );
+    REQUIRE( arr->children->tokens[1]->end_in - arr->children->tokens[1]->start_in == 2 );
+    REQUIRE( arr->children->tokens[2]->end_in - arr->children->tokens[2]->start_in == 3 );
+    json_parser_cleanup(p);
+
+    const char *bad[] = {"[\"abc", "[\"abc\\", "[\"abc\\\"]"};
+    for (int i = 0; i < 3; i++) {
+        json_parser *q = json_parser_create((char*) bad[i]);
+        REQUIRE( json_parsearr(q, q->all_tokens->tokens[0]) == false );
+        json_parser_cleanup(q);
+    }
+}
+
+TEST_CASE( "json_parser_structurals", "[json_parse_indexed]" )
+{
+    char *input = "{\"a\\\"\": [12, true], \"b\": \"x,y\"}";
+    json_parser *p = json_parser_create(input);
+    int n = json_parser_structurals(p);
+    int expected[] = {0, 1, 5, 6, 8, 9, 11, 13, 17, 18, 20, 22, 23, 25, 29, 30, 31};
+    REQUIRE( n == (int) (sizeof(expected) / sizeof(expected[0])) );
+    for (int i = 0; i < n; i++)
+        REQUIRE( p->structurals[i] == expected[i] );
+    json_parser_cleanup(p);
+}
+
+/** Parses input with the reference and indexed engines and requires the same
+    verdict and, on success, the same tokens and tape */
+static void
+require_same_parse(const std::string &input)
+{
+    INFO( "input: " << input );
+    json_parser *ref = json_parser_create_n(input.data(), (int) input.size());
+    json_parser *idx = json_parser_create_n(input.data(), (int) input.size());
+    json_parser_enable_tape(ref);
+    json_parser_enable_tape(idx);
+    bool ref_ok = json_parsevalue(ref, ref->all_tokens->tokens[0]);
+    bool idx_ok = json_parse_indexed(idx, idx->all_tokens->tokens[0]);
+    REQUIRE( ref_ok == idx_ok );
+    REQUIRE( ref->all_tokens->tokens[0]->error == idx->all_tokens->tokens[0]->error );
+    if (ref_ok) {
+        REQUIRE( ref->curr == idx->curr );
+        REQUIRE( ref->all_tokens->length == idx->all_tokens->length );
+        /** Token 0 is the wrapper, whose offsets are never set */
+        for (int i = 1; i < ref->all_tokens->length; i++) {
+            json_jsontoken *a = ref->all_tokens->tokens[i];
+            json_jsontoken *b = idx->all_tokens->tokens[i];
+            REQUIRE( a->type == b->type );
+            REQUIRE( a->start_in == b->start_in );
+            REQUIRE( a->end_in == b->end_in );
+            REQUIRE( (a->parent ? a->parent->index : -1) == (b->parent ? b->parent->index : -1) );
+            REQUIRE( a->children->length == b->children->length );
+            for (int c = 0; c < a->children->length; c++)
+                REQUIRE( a->children->tokens[c]->index == b->children->tokens[c]->index );
+        }
+        REQUIRE( ref->tape->length == idx->tape->length );
+        REQUIRE( memcmp(ref->tape->entries, idx->tape->entries,
+            sizeof(json_tape_entry) * ref->tape->length) == 0 );
+    }
+    json_parser_cleanup(ref);
+    json_parser_cleanup(idx);
+}
+
+TEST_CASE( "json_parse_indexed_differential", "[json_parse_indexed]" )
+{
+    const char *inputs[] = {
+        "[]", "{}", "[1]", "\"s\"", "12", "-1.5e3", "true", "null",
+        "{\"a\": [1, 2.5, \"x\", true, false, null, {}, []], \"b\": {\"c\": {\"d\": []}}}",
+        "[ \"\\\\\", \"\\\"\", \"a\\\\\\\"b\", \"}]\", \"{[:,\" ]",
+        " [1]", "[1] x", "[1 2]", "[1,]", "[,1]", "[1,,2]", "[true1]", "[\"a\"1]", "[1\"a\"]",
+        "{\"a\" \"b\": 1}", "{\"a\":}", "{:1}", "{\"a\"::1}", "{1: 2}", "{\"a\": 1,, \"b\": 2}",
+        "[1", "[\"abc", "[\"abc\\", "{\"a\": [1, {\"b\": ]}", "[}", "{]", "[:]", "[\\\"]",
+        "[nul]", "[tru]", "[falsey]", "[1.2.3]", "[--1]", "[1e5e]", "{\"a\":1}}", "x", "",
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+        require_same_parse(inputs[i]);
+
+    /** Escapes and strings straddling 64-byte block boundaries */
+    for (int pad = 0; pad < 70; pad++) {
+        require_same_parse("[\"" + std::string(pad, 'a') + "\\\\\", \"\\\"" + std::string(pad, ' ') + "\"]");
+        require_same_parse("{" + std::string(pad, ' ') + "\"k\\\\\\\"\":" + std::string(pad % 7, '\n') + "1}");
+        require_same_parse("[" + std::string(pad, '1') + "]");
+    }
+    require_same_parse(std::string(300, '[') + std::string(300, ']'));
+
+    /** NUL bytes inside string bodies, reachable only through an explicit length */
+    require_same_parse(std::string("[\"x\0\",\"y\"]", 10));
+    require_same_parse(std::string("{\"a\0\":1}", 9));
+    require_same_parse(std::string("[\"\\\0\"]", 6));
+    require_same_parse("[\"" + std::string(70, 'a') + std::string("\0\"]", 3));
+}
+
+/** Appends a random valid value of at most the given depth */
+static void
+random_value(std::string &doc, unsigned int &seed, int depth)
+{
+    static const char *scalars[] = {
+        "0", "-12.5e3", "1E-2", "true", "false", "null", "\"\"", "\"str\\\"\\\\ing\"",
+        "\"{[:,]}\"", "\"\\\\\\\\\\\\\"",
+    };
+    static const char *spaces[] = {"", " ", "\n    ", "\t\r\n",
+        "                                                                  "};
+    seed = seed * 1103515245 + 12345;
+    int kind = depth > 0 ? (seed >> 16) % 4 : 0;
+    if (kind == 0 || kind == 1) {
+        doc += scalars[(seed >> 20) % 10];
+        return;
+    }
+    int n = (seed >> 20) % 5;
+    doc += kind == 2 ? '[' : '{';
+    for (int i = 0; i < n; i++) {
+        if (i)
+            doc += ',';
+        doc += spaces[(seed >> (8 + i)) % 5];
+        if (kind == 3) {
+            doc += "\"k" + std::to_string(i) + "\\\"\"";
+            doc += spaces[(seed >> (12 + i)) % 5];
+            doc += ':';
+        }
+        random_value(doc, seed, depth - 1);
+    }
+    doc += spaces[(seed >> 24) % 5];
+    doc += kind == 2 ? ']' : '}';
+}
+
+TEST_CASE( "json_parse_indexed_random", "[json_parse_indexed]" )
+{
+    /** Random documents, then the same documents with one byte replaced */
+    const char pieces[] = "{}[]:,\"\\ \n0123456789-.eEtruefalsnl";
+    unsigned int seed = 12345;
+    for (int round = 0; round < 500; round++) {
+        std::string doc;
+        random_value(doc, seed, 6);
+        require_same_parse(doc);
+        seed = seed * 1103515245 + 12345;
+        std::string mutated = doc;
+        mutated[(seed >> 8) % mutated.size()] = pieces[(seed >> 20) % (sizeof(pieces) - 1)];
+        require_same_parse(mutated);
+    }
+}
+
+TEST_CASE( "json_char_class", "[json_char_class]" )
+{
+    for (int i = 0; i < 256; i++) {
+        char c = (char) i;
+        bool ws = c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+        REQUIRE( (bool) json_iswhitespace(c) == ws );
+        REQUIRE( (bool) json_isnumericalishchar(c) == (c == '-' || (c >= '0' && c <= '9')) );
+        bool numend = ws || c == ']' || c == '}' || c == ',' || c == STR_END;
+        REQUIRE( ((JSON_CLASS(c) & JSON_CLASS_NUMEND) != 0) == numend );
+    }
+    REQUIRE( (JSON_CLASS('"') & JSON_CLASS_VALUE) == JSON_CLASS_STR );
+    REQUIRE( (JSON_CLASS('n') & JSON_CLASS_VALUE) == JSON_CLASS_NULL );
+    REQUIRE( (JSON_CLASS('t') & JSON_CLASS_VALUE) == JSON_CLASS_BOOL );
+    REQUIRE( (JSON_CLASS('f') & JSON_CLASS_VALUE) == JSON_CLASS_BOOL );
+    REQUIRE( (JSON_CLASS('{') & JSON_CLASS_VALUE) == JSON_CLASS_OBJ );
+    REQUIRE( (JSON_CLASS('[') & JSON_CLASS_VALUE) == JSON_CLASS_ARR );
+    REQUIRE( (JSON_CLASS(']') & JSON_CLASS_VALUE) == JSON_CLASS_INVALID );
+    REQUIRE( (JSON_CLASS((char) 0xff) & JSON_CLASS_VALUE) == JSON_CLASS_INVALID );
+}
+
+TEST_CASE( "json_parsevalue", "[json_char_class]" )
+{
+    const char *inputs[] = {"-1", "\"a\"", "null", "true", "false", "{}", "[]", "x", "]", ""};
+    json_jsontoken_type types[] = {JSON_INT, JSON_STR, JSON_NUL, JSON_BOO, JSON_BOO, JSON_OBJ, JSON_ARR};
+    for (int i = 0; i < 10; i++) {
+        json_parser *p = json_parser_create((char*) inputs[i]);
+        json_jsontoken *outer = p->all_tokens->tokens[0];
+        bool ok = json_parsevalue(p, outer);
+        REQUIRE( ok == (i < 7) );
+        REQUIRE( outer->error == (i >= 7) );
+        if (ok)
+            REQUIRE( outer->children->tokens[0]->type == types[i] );
+        json_parser_cleanup(p);
+    }
+}
+
+TEST_CASE( "json_kernel_select", "[json_kernel]" )
+{
+    REQUIRE( json_kernel_supported(JSON_KERNEL_SCALAR) );
+    REQUIRE( json_kernel_active() != JSON_KERNEL_AUTO );
+    REQUIRE( json_kernel_select((json_kernel) 99) == false );
+
+    /** Whitespace and string runs cut off by the bound at every offset near a page boundary */
+    char *page = NULL;
+    REQUIRE( posix_memalign((void**) &page, 4096, 8192) == 0 );
+    unsigned int seed = 7;
+    const char alphabet[] = " \t\n\"\\ax{}[]:,0\xe9";
+    for (int k = JSON_KERNEL_SCALAR; k <= JSON_KERNEL_AVX512; k++) {
+        if (!json_kernel_supported((json_kernel) k))
+            continue;
+        INFO( "kernel: " << json_kernel_name((json_kernel) k) );
+        REQUIRE( json_kernel_select((json_kernel) k) );
+        REQUIRE( json_kernel_active() == k );
+        for (int end = 4096 - 80; end < 4096 + 80; end++) {
+            for (int start = end - 70; start <= end; start += 3) {
+                memset(page, ' ', 8192);
+                memset(page + start, '\n', end - start);
+                REQUIRE( json_skipws(page, start, end) == end );
+                memset(page, 'a', 8192);
+                REQUIRE( json_scanstr(page, start, end) == end );
+                page[end] = '\\';
+                REQUIRE( json_scanstr(page, start, end + 1) == end );
+                /** Only bytes before the stop count as passed over */
+                bool high = false;
+                page[end + 1] = (char) 0xe9;
+                REQUIRE( json_scanstr_high(page, start, end + 2, &high) == end );
+                REQUIRE_FALSE( high );
+                if (end > start) {
+                    page[start + (end - start) / 2] = (char) 0xe9;
+                    REQUIRE( json_scanstr_high(page, start, end + 2, &high) == end );
+                    REQUIRE( high );
+                }
+            }
+        }
+        for (int round = 0; round < 200; round++) {
+            char block[64];
+            for (int i = 0; i < 64; i++) {
+                seed = seed * 1103515245 + 12345;
+                block[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+            }
+            uint64_t q, b, o, w, q2, b2, o2, w2;
+            uint64_t h = json_index_classify(block, &q, &b, &o, &w);
+            REQUIRE( h == json_index_classify_scalar(block, &q2, &b2, &o2, &w2) );
+            REQUIRE( q == q2 );
+            REQUIRE( b == b2 );
+            REQUIRE( o == o2 );
+            REQUIRE( w == w2 );
+            json_index_brackets(block, &q, &b, &o, &w);
+            json_index_brackets_scalar(block, &q2, &b2, &o2, &w2);
+            REQUIRE( q == q2 );
+            REQUIRE( b == b2 );
+            REQUIRE( o == o2 );
+            REQUIRE( w == w2 );
+        }
+        require_same_parse("{\"a\\\\\": [1, \"" + std::string(100, 'x') + "\\\"\"],"
+            + std::string(70, ' ') + "\"b\": {}}");
+    }
+    free(page);
+
+    /** Each level is one fixed table, and CJSON_KERNEL picks among them for AUTO */
+    for (int k = JSON_KERNEL_SCALAR; k <= JSON_KERNEL_AVX512; k++) {
+        const json_kernels *table = json_kernel_table((json_kernel) k);
+        REQUIRE( (table != NULL) == (json_kernel_supported((json_kernel) k) != 0) );
+        if (table != NULL)
+            REQUIRE( table->kernel == k );
+    }
+    REQUIRE( json_kernel_table(JSON_KERNEL_AUTO) == NULL );
+    setenv("CJSON_KERNEL", "scalar", 1);
+    REQUIRE( json_kernel_default() == JSON_KERNEL_SCALAR );
+    REQUIRE( json_kernel_select(JSON_KERNEL_AUTO) );
+    REQUIRE( json_kernels_get() == &json_kernels_scalar );
+    unsetenv("CJSON_KERNEL");
+
+    /** Switching kernels while other threads parse leaves every parse intact */
+    std::string doc = "[";
+    for (int i = 0; i < 200; i++)
+        doc += "{\"k\": \"" + std::string(i % 70, 'v') + "\\n\",  \"n\": [1, 2.5, true]}, ";
+    doc += "null]";
+    json_parser *expect = json_parser_create((char*) doc.c_str());
+    REQUIRE( json_parsevalue(expect, expect->all_tokens->tokens[0]) );
+    int tokens = expect->all_tokens->length;
+    json_parser_cleanup(expect);
+    std::vector<int> failures(4, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&doc, &failures, tokens, t]() {
+            json_parser *p = json_parser_create((char*) doc.c_str());
+            for (int r = 0; r < 50; r++) {
+                json_parser_reset(p, (char*) doc.c_str());
+                json_jsontoken *outer = p->all_tokens->tokens[0];
+                bool ok = r % 2 ? json_parse_indexed(p, outer) : json_parsevalue(p, outer);
+                if (!ok || p->all_tokens->length != tokens)
+                    failures[t]++;
+            }
+            json_parser_cleanup(p);
+        }));
+    }
+    for (int r = 0; r < 200; r++)
+        json_kernel_select((json_kernel) (JSON_KERNEL_SCALAR + r % JSON_KERNEL_AVX512));
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    for (int t = 0; t < 4; t++)
+        REQUIRE( failures[t] == 0 );
+    REQUIRE( json_kernel_select(JSON_KERNEL_AUTO) );
+}
+
+TEST_CASE( "json_match4", "[json_parsebool]" )
+{
+    REQUIRE( json_match4("null", 4, "null") );
+    REQUIRE( json_match4("alse,", 5, "alse") );
+    REQUIRE_FALSE( json_match4("nul", 3, "null") );
+    REQUIRE_FALSE( json_match4("nulL", 4, "null") );
+    REQUIRE_FALSE( json_match4("null", 3, "null") );
+
+    /** Unterminated literals cut short right before an unreadable page */
+    long pagesize = sysconf(_SC_PAGESIZE);
+    char *pages = (char*) mmap(NULL, 2 * pagesize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    REQUIRE( pages != MAP_FAILED );
+    REQUIRE( mprotect(pages + pagesize, pagesize, PROT_NONE) == 0 );
+    const char *docs[] = {"[true]", "[false]", "[null]", "[tru", "[fals", "[nul", "[t", "[f", "[n"};
+    bool valid[] = {true, true, true, false, false, false, false, false, false};
+    for (int i = 0; i < 9; i++) {
+        size_t len = strlen(docs[i]);
+        char *doc = pages + pagesize - len;
+        memcpy(doc, docs[i], len);
+        json_parser *p = json_parser_create_n(doc, len);
+        REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == valid[i] );
+        if (valid[i]) {
+            json_jsontoken *literal = p->all_tokens->tokens[2];
+            REQUIRE( literal->start_in == 1 );
+            REQUIRE( literal->end_in == (int) len - 1 );
+        }
+        json_parser_cleanup(p);
+    }
+    munmap(pages, 2 * pagesize);
+}
+
+TEST_CASE( "json_parse_int64", "[json_token_get]" )
+{
+    const char *ok[] = {"0", "-0", "7", "-12345678", "123456789012345678",
+        "9223372036854775807", "-9223372036854775808"};
+    int64_t expected[] = {0, 0, 7, -12345678, 123456789012345678LL,
+        INT64_MAX, INT64_MIN};
+    for (int i = 0; i < 7; i++) {
+        int64_t value = 1;
+        REQUIRE( json_parse_int64(ok[i], (int) strlen(ok[i]), &value) );
+        REQUIRE( value == expected[i] );
+    }
+    const char *bad[] = {"", "-", "01", "-01", "1.0", "1e3", "9223372036854775808",
+        "-9223372036854775809", "1a", "123456789012345678901", "+1"};
+    for (int i = 0; i < 11; i++) {
+        int64_t value;
+        REQUIRE_FALSE( json_parse_int64(bad[i], (int) strlen(bad[i]), &value) );
+    }
+
+    uint64_t u;
+    REQUIRE( json_parse_uint64("18446744073709551615", 20, &u) );
+    REQUIRE( u == UINT64_MAX );
+    REQUIRE_FALSE( json_parse_uint64("18446744073709551616", 20, &u) );
+    REQUIRE_FALSE( json_parse_uint64("-1", 2, &u) );
+
+    /** Round trip random values of every length */
+    unsigned long long seed = 99;
+    char buf[32];
+    for (int i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        int64_t v = (int64_t) (seed >> (i % 64));
+        if (i % 3 == 0)
+            v = -v;
+        int n = snprintf(buf, sizeof(buf), "%lld", (long long) v);
+        int64_t back;
+        REQUIRE( json_parse_int64(buf, n, &back) );
+        REQUIRE( back == v );
+        n = snprintf(buf, sizeof(buf), "%llu", (unsigned long long) (seed >> (i % 64)));
+        REQUIRE( json_parse_uint64(buf, n, &u) );
+        REQUIRE( u == (seed >> (i % 64)) );
+    }
+}
+
+TEST_CASE( "json_parse_double", "[json_token_get]" )
+{
+    const char *ok[] = {"0", "-0", "1.5", "-122.4194155", "1e3", "1E-3", "2.5e+2",
+        "0.000123", "9007199254740993", "1e23", "123456789012345678901234567890",
+        "4.9406564584124654e-324", "1.7976931348623157e308", "0.1", "1e400", "-1e-400"};
+    for (int i = 0; i < 16; i++) {
+        double value = 42, expected = strtod(ok[i], NULL);
+        INFO( ok[i] );
+        REQUIRE( json_parse_double(ok[i], (int) strlen(ok[i]), &value) );
+        REQUIRE( memcmp(&value, &expected, sizeof(double)) == 0 );
+    }
+    const char *bad[] = {"", "-", "01", "1.", ".5", "1e", "1e+", "1.2.3", "--1", "1x", "+1", "NaN"};
+    for (int i = 0; i < 12; i++) {
+        double value;
+        REQUIRE_FALSE( json_parse_double(bad[i], (int) strlen(bad[i]), &value) );
+    }
+
+    /** Shortest and full-precision renderings of random doubles come back bit for bit */
+    unsigned long long seed = 5;
+    char buf[512];
+    for (int i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        double v;
+        if (i % 2) {
+            unsigned long long bits = seed & 0x7fefffffffffffffULL;
+            memcpy(&v, &bits, sizeof(v));
+        } else {
+            v = (double) (int64_t) (seed >> 40) / json_pow10[seed % 9];
+        }
+        const char *formats[] = {"%.17g", "%.15g", "%.6f", "%.3e"};
+        for (int f = 0; f < 4; f++) {
+            int n = snprintf(buf, sizeof(buf), formats[f], v);
+            double back, expected = strtod(buf, NULL);
+            INFO( buf );
+            REQUIRE( json_parse_double(buf, n, &back) );
+            REQUIRE( memcmp(&back, &expected, sizeof(double)) == 0 );
+        }
+    }
+}
+
+TEST_CASE( "json_token_get", "[json_token_get]" )
+{
+    char *arr_str = "[42, -7.25, \"9\", 18446744073709551615]";
+    json_parser *p = json_parser_create(arr_str);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken **items = p->all_tokens->tokens[1]->children->tokens;
+    int64_t i;
+    uint64_t u;
+    double d;
+    REQUIRE( json_token_get_int64(p, items[0], &i) );
+    REQUIRE( i == 42 );
+    REQUIRE( json_token_get_double(p, items[0], &d) );
+    REQUIRE( d == 42.0 );
+    REQUIRE_FALSE( json_token_get_int64(p, items[1], &i) );
+    REQUIRE( json_token_get_double(p, items[1], &d) );
+    REQUIRE( d == -7.25 );
+    REQUIRE_FALSE( json_token_get_double(p, items[2], &d) );
+    REQUIRE_FALSE( json_token_get_int64(p, items[3], &i) );
+    REQUIRE( json_token_get_uint64(p, items[3], &u) );
+    REQUIRE( u == UINT64_MAX );
+
+    /** A decimal comma locale does not change the result, on any thread */
+    const char *comma[] = {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8", "de_DE", "fr_FR"};
+    const char *slow[] = {"1.25e-400", "0.1000000000000000000001", "2.2250738585072014e-308",
+        "123456789012345678901.5", "-9.8765432109876543210e100", "1.7976931348623157e308"};
+    double expected[6];
+    for (int i = 0; i < 6; i++)
+        expected[i] = strtod(slow[i], NULL);
+    const char *name = NULL;
+    for (int i = 0; i < 6 && name == NULL; i++)
+        name = setlocale(LC_NUMERIC, comma[i]);
+    if (name == NULL)
+        WARN( "no decimal comma locale installed" );
+    else {
+        REQUIRE( strcmp(localeconv()->decimal_point, ",") == 0 );
+        for (int i = 0; i < 6; i++) {
+            INFO( slow[i] );
+            REQUIRE( json_parse_double(slow[i], (int) strlen(slow[i]), &d) );
+            REQUIRE( memcmp(&d, &expected[i], sizeof(double)) == 0 );
+        }
+        std::vector<int> failures(4, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.push_back(std::thread([&slow, &expected, &failures, t]() {
+                for (int r = 0; r < 2000; r++) {
+                    double value;
+                    int i = r % 6;
+                    if (!json_parse_double(slow[i], (int) strlen(slow[i]), &value) ||
+                        memcmp(&value, &expected[i], sizeof(double)) != 0)
+                        failures[t]++;
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+        for (int t = 0; t < 4; t++)
+            REQUIRE( failures[t] == 0 );
+        setlocale(LC_NUMERIC, "C");
+    }
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_parser_create_n", "[json_parser_create_n]" )
+{
+    /** A slice of a larger buffer stops at its length */
+    const char *text = "[1, 22, \"ab\"] trailing garbage";
+    json_parser *p = json_parser_create_n(text, 13);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->curr == 13 );
+    REQUIRE( p->all_tokens->tokens[1]->children->length == 3 );
+    json_parser_reset_n(p, text, 6);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_parser_reset_n(p, "[1, 2]", 2);
+    REQUIRE( json_parser_presize(p) == false );
+    json_parser_cleanup(p);
+
+    json_tape_entry entries[16];
+    int count = 0;
+    REQUIRE( json_parse_into_n(text, 13, entries, 8, &count) == JSON_OK );
+    REQUIRE( count == 5 );
+    REQUIRE( json_parse_into_n(text, 14, entries, 8, &count) == JSON_OK );
+    REQUIRE( json_parse_into_n(text, 15, entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into_n("nul", 3, entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into_n("12", 1, entries, 8, &count) == JSON_OK );
+    REQUIRE( entries[1].length == 1 );
+    /** An embedded terminator inside the length is not the end of input */
+    REQUIRE( json_parse_into_n("[1]\0", 4, entries, 8, &count) == JSON_INVALID );
+
+    /** Nor does a NUL end or belong to a string, escaped or not */
+    const char nul_quoted[] = {'[', '"', 0, '"', ']', '"', ']'};
+    const char nul_escaped[] = {'[', '"', '\\', 0, '"', ']'};
+    const char nul_body[] = {'[', '"', 'a', 0, 'b', '"', ']'};
+    REQUIRE( json_parse_into_n(nul_quoted, 7, entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into_n(nul_escaped, 6, entries, 8, &count) == JSON_INVALID );
+    REQUIRE( json_parse_into_n(nul_body, 7, entries, 8, &count) == JSON_INVALID );
+    p = json_parser_create_n(nul_body, 7);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_parser_reset_n(p, nul_escaped, 6);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_parser_cleanup(p);
+
+    /** Documents that fill a page right up to an unreadable one */
+    long pagesize = sysconf(_SC_PAGESIZE);
+    char *pages = (char*) mmap(NULL, 2 * pagesize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    REQUIRE( pages != MAP_FAILED );
+    REQUIRE( mprotect(pages + pagesize, pagesize, PROT_NONE) == 0 );
+    const char *docs[] = {"{\"k\": [true, false, null, -1.5e3, \"s\\\\\"]}", "  \"unterminated",
+        "123456789", "[\"" };
+    bool valid[] = {true, false, true, false};
+    for (int i = 0; i < 4; i++) {
+        std::string doc = std::string(docs[i]) + std::string(100, ' ');
+        for (size_t pad = 0; pad < 100; pad += 7) {
+            size_t len = strlen(docs[i]) + pad;
+            char *at = pages + pagesize - len;
+            memcpy(at, doc.c_str(), len);
+            INFO( docs[i] << " padded by " << pad );
+            p = json_parser_create_n(at, len);
+            /** Presizing only tracks nesting, so its verdict is not compared */
+            json_parser_presize(p);
+            REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == valid[i] );
+            json_parser_reset_n(p, at, len);
+            REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) == valid[i] );
+            json_parser_cleanup(p);
+            REQUIRE( (json_parse_into_n(at, len, entries, 16, &count) == JSON_OK) == valid[i] );
+        }
+    }
+    munmap(pages, 2 * pagesize);
+}
+
+TEST_CASE( "json_unescape", "[json_token_get_string]" )
+{
+    char out[64];
+    const char *plain = "plain";
+    REQUIRE( json_unescape(plain, 5, out, sizeof(out)) == 5 );
+    REQUIRE( strcmp(out, "plain") == 0 );
+    const char *simple = "a\\\"b\\\\c\\/d\\be\\ff\\ng\\rh\\ti";
+    REQUIRE( json_unescape(simple, strlen(simple), out, sizeof(out)) == 17 );
+    REQUIRE( strcmp(out, "a\"b\\c/d\be\ff\ng\rh\ti") == 0 );
+    const char *unicode = "\\u0041\\u00e9\\u20AC\\ud83d\\ude00";
+    REQUIRE( json_unescape(unicode, strlen(unicode), out, sizeof(out)) == 10 );
+    REQUIRE( strcmp(out, "A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80") == 0 );
+
+    const char *bad[] = {"\\x", "a\\", "\\u12", "\\u12g4", "\\ud83d", "\\ud83dx\\ude00",
+        "\\ude00", "\\ud83d\\u0041", "\\ud83d\\n"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        INFO( bad[i] );
+        REQUIRE( json_unescape(bad[i], strlen(bad[i]), out, sizeof(out)) == -1 );
+    }
+
+    /** Short buffers are filled and terminated, like snprintf */
+    REQUIRE( json_unescape(simple, strlen(simple), out, 4) == 17 );
+    REQUIRE( strcmp(out, "a\"b") == 0 );
+    REQUIRE( json_unescape(unicode, strlen(unicode), NULL, 0) == 10 );
+
+    /** An escape at every offset across several vectors */
+    for (int at = 0; at < 149; at++) {
+        std::string raw(150, 'x'), expected(149, 'x');
+        raw.replace(at, 2, "\\n");
+        expected.replace(at, 1, "\n");
+        std::vector<char> buf(raw.size() + 1);
+        REQUIRE( json_unescape(raw.data(), raw.size(), buf.data(), buf.size()) == 149 );
+        REQUIRE( std::string(buf.data()) == expected );
+    }
+}
+
+TEST_CASE( "json_token_get_string", "[json_token_get_string]" )
+{
+    char *arr_str = "[\"raw\", \"tab\\there\", \"\\ud83d\\ude00\", 1, \"bad\\q\"]";
+    json_parser *p = json_parser_create(arr_str);
+    REQUIRE( json_parsearr(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken **items = p->all_tokens->tokens[1]->children->tokens;
+    REQUIRE( items[0]->escaped == false );
+    REQUIRE( items[1]->escaped == true );
+
+    char out[16];
+    REQUIRE( json_token_get_string(p, items[1], out, sizeof(out)) == 8 );
+    REQUIRE( strcmp(out, "tab\there") == 0 );
+    REQUIRE( json_token_get_string(p, items[3], out, sizeof(out)) == -1 );
+    REQUIRE( json_token_get_string(p, items[4], out, sizeof(out)) == -1 );
+
+    int length;
+    const char *view = json_token_get_string_view(p, items[0], &length, NULL, 0);
+    REQUIRE( view == arr_str + 2 );
+    REQUIRE( length == 3 );
+    view = json_token_get_string_view(p, items[2], &length, out, sizeof(out));
+    REQUIRE( view == out );
+    REQUIRE( length == 4 );
+    REQUIRE( memcmp(view, "\xf0\x9f\x98\x80", 4) == 0 );
+    REQUIRE( json_token_get_string_view(p, items[1], &length, out, 8) == NULL );
+    REQUIRE( length == 9 );
+    REQUIRE( json_token_get_string_view(p, items[3], &length, out, sizeof(out)) == NULL );
+    REQUIRE( length == -1 );
+
+    /** The indexed engine does not track escapes, so views check the text */
+    json_parser_reset(p, arr_str);
+    REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) == true );
+    items = p->all_tokens->tokens[1]->children->tokens;
+    REQUIRE( json_token_get_string_view(p, items[0], &length, NULL, 0) == arr_str + 2 );
+    REQUIRE( json_token_get_string_view(p, items[1], &length, out, sizeof(out)) == out );
+    REQUIRE( length == 8 );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_utf8_sequence", "[json_utf8]" )
+{
+    const char *good[] = {"a", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf",
+        "\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf"};
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++)
+        REQUIRE( json_utf8_sequence(good[i], strlen(good[i])) == (int) strlen(good[i]) );
+    /** Stray continuations, overlongs, surrogates, past U+10FFFF, cut short */
+    const char *bad[] = {"\x80", "\xc0\xaf", "\xc1\xbf", "\xe0\x9f\xbf", "\xed\xa0\x80",
+        "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xc2",
+        "\xe2\x82", "\xc2\x41", "\xe2\x28\xa1"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        INFO( i );
+        REQUIRE( json_utf8_sequence(bad[i], strlen(bad[i])) == 0 );
+    }
+    REQUIRE( json_utf8_sequence("\xe2\x82\xac", 2) == 0 );
+}
+
+TEST_CASE( "json_utf8_check", "[json_utf8]" )
+{
+    /** A bad byte at every offset of mixed text, on every kernel */
+    std::string text;
+    while (text.size() < 200)
+        text += "ascii \xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80 ";
+    for (int k = JSON_KERNEL_SCALAR; k <= JSON_KERNEL_AVX512; k++) {
+        if (!json_kernel_supported((json_kernel) k))
+            continue;
+        INFO( "kernel: " << json_kernel_name((json_kernel) k) );
+        REQUIRE( json_kernel_select((json_kernel) k) );
+        REQUIRE( json_utf8_check(text.data(), 0, text.size()) == (int) text.size() );
+        for (size_t at = 0; at < 150; at++) {
+            /** Only offsets that start a sequence are reported */
+            if (((unsigned char) text[at] & 0xc0) == 0x80)
+                continue;
+            std::string broken = text;
+            broken[at] = (char) 0xff;
+            REQUIRE( json_utf8_check(broken.data(), 0, broken.size()) == (int) at );
+            REQUIRE( json_utf8_check(broken.data(), 0, at) == (int) at );
+        }
+        /** Valid sequences with the odd random byte, against the scalar kernel */
+        const char *pieces[] = {"a", "~", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf",
+            "\xee\x80\x80", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf", "\xf3\xbf\xbf\xbf"};
+        unsigned int seed = 11;
+        for (int round = 0; round < 3000; round++) {
+            std::string doc;
+            seed = seed * 1103515245 + 12345;
+            int pieces_n = (seed >> 16) % 80;
+            for (int i = 0; i < pieces_n; i++) {
+                seed = seed * 1103515245 + 12345;
+                if ((seed >> 16) % 97 == 0)
+                    doc += (char) (seed >> 8);
+                else
+                    doc += pieces[(seed >> 16) % 10];
+            }
+            REQUIRE( json_utf8_check(doc.data(), 0, doc.size()) ==
+                json_utf8_scalar(doc.data(), 0, doc.size()) );
+        }
+    }
+    REQUIRE( json_kernel_select(JSON_KERNEL_AUTO) );
+}
+
+TEST_CASE( "json_parser_enable_utf8", "[json_utf8]" )
+{
+    char *good = "{\"caf\xc3\xa9\": [\"\xe6\x97\xa5\", \"\\u00e9\"]}";
+    char *bad = "[\"ok\", \"caf\xc3\x28\"]";
+    json_parser *p = json_parser_create(bad);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->utf8_error == -1 );
+
+    json_parser_enable_utf8(p);
+    json_parser_reset(p, bad);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    REQUIRE( p->utf8_error == 11 );
+    json_parser_reset(p, bad);
+    REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) == false );
+    REQUIRE( p->utf8_error == 11 );
+
+    json_parser_reset(p, good);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    REQUIRE( p->utf8_error == -1 );
+    json_parser_reset(p, good);
+    REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) == true );
+
+    /** Checking runs ahead in windows: sequences across every window edge
+        are fine, and a bad one far ahead only fails the string holding it */
+    std::string doc = "[";
+    while (doc.size() < 3 * JSON_UTF8_WINDOW)
+        doc += "\"\xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80\", ";
+    doc += "\"last\"]";
+    for (int engine = 0; engine < 2; engine++) {
+        json_parser_reset(p, (char*) doc.c_str());
+        json_jsontoken *outer = p->all_tokens->tokens[0];
+        REQUIRE( (engine ? json_parse_indexed(p, outer) : json_parsevalue(p, outer)) == true );
+        REQUIRE( p->utf8_error == -1 );
+    }
+    std::string broken = doc;
+    size_t at = broken.size() - 10;
+    while (broken[at] != '\xe6')
+        at--;
+    broken[at + 1] = 'x';
+    for (int engine = 0; engine < 2; engine++) {
+        json_parser_reset(p, (char*) broken.c_str());
+        json_jsontoken *outer = p->all_tokens->tokens[0];
+        REQUIRE( (engine ? json_parse_indexed(p, outer) : json_parsevalue(p, outer)) == false );
+        REQUIRE( p->utf8_error == (int) at );
+    }
+
+    /** Only bodies that are not ASCII are looked up, however far in they start,
+        and the byte after a backslash belongs to the body */
+    std::string late = "[\"" + std::string(5 * JSON_UTF8_WINDOW, 'a') + "\", \"caf\xc3\x28\"]";
+    std::string escaped = "[\"x\", \"\\\xff\"]";
+    for (int engine = 0; engine < 2; engine++) {
+        json_parser_reset(p, (char*) late.c_str());
+        json_jsontoken *outer = p->all_tokens->tokens[0];
+        REQUIRE( (engine ? json_parse_indexed(p, outer) : json_parsevalue(p, outer)) == false );
+        REQUIRE( p->utf8_error == (int) late.find('\xc3') );
+        json_parser_reset(p, (char*) escaped.c_str());
+        outer = p->all_tokens->tokens[0];
+        REQUIRE( (engine ? json_parse_indexed(p, outer) : json_parsevalue(p, outer)) == false );
+        REQUIRE( p->utf8_error == 8 );
+    }
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_obj_get", "[json_obj_get]" )
+{
+    char *small = "{\"a\": 1, \"b\\u0063\": [2], \"a\": 3, \"\": null}";
+    json_parser *p = json_parser_create(small);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken *obj = p->all_tokens->tokens[1];
+    json_jsontoken *value = json_obj_get(p, obj, "a", 1);
+    REQUIRE( value != NULL );
+    REQUIRE( value->start_in == 6 );
+    value = json_obj_get(p, obj, "bc", 2);
+    REQUIRE( value != NULL );
+    REQUIRE( value->type == JSON_ARR );
+    REQUIRE( json_obj_get(p, obj, "b\\u0063", 7) == NULL );
+    REQUIRE( json_obj_get(p, obj, "", 0)->type == JSON_NUL );
+    REQUIRE( json_obj_get(p, obj, "ab", 2) == NULL );
+    REQUIRE( json_obj_get(p, value, "a", 1) == NULL );
+    REQUIRE( p->obj_indexes == NULL );
+
+    /** Wide objects go through the hash index, built once and kept until reset */
+    std::string wide = "{";
+    for (int i = 0; i < 300; i++)
+        wide += (i ? ", \"key" : "\"key") + std::to_string(i) + "\": " + std::to_string(i);
+    wide += ", \"key7\": -1, \"esc\\\"aped\": true}";
+    json_parser_reset(p, (char*) wide.c_str());
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    obj = p->all_tokens->tokens[1];
+    for (int i = 0; i < 300; i++) {
+        std::string key = "key" + std::to_string(i);
+        value = json_obj_get(p, obj, key.data(), key.size());
+        REQUIRE( value != NULL );
+        int64_t n;
+        REQUIRE( json_token_get_int64(p, value, &n) );
+        REQUIRE( n == i );
+    }
+    REQUIRE( p->obj_indexes[obj->index] != NULL );
+    REQUIRE( p->obj_indexes[obj->index]->capacity == 1024 );
+    REQUIRE( json_obj_get(p, obj, "key300", 6) == NULL );
+    REQUIRE( json_obj_get(p, obj, "key", 3) == NULL );
+    REQUIRE( json_obj_get(p, obj, "esc\"aped", 8)->type == JSON_BOO );
+
+    /** The indexed engine builds the same tree */
+    json_parser_reset(p, (char*) wide.c_str());
+    REQUIRE( p->obj_indexes == NULL );
+    REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) == true );
+    obj = p->all_tokens->tokens[1];
+    REQUIRE( json_obj_get(p, obj, "key299", 6)->start_in == (int) wide.find("299, \"key7\"") );
+    REQUIRE( json_obj_get(p, obj, "esc\"aped", 8)->type == JSON_BOO );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_pointer_get", "[json_pointer]" )
+{
+    /** The examples of RFC 6901 section 5 */
+    char *doc = "{\"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1, \"c%d\": 2, \"e^f\": 3,"
+        " \"g|h\": 4, \"i\\\\j\": 5, \"k\\\"l\": 6, \" \": 7, \"m~n\": 8}";
+    json_parser *p = json_parser_create(doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken *root = p->all_tokens->tokens[1];
+    REQUIRE( json_pointer_get(p, root, "") == root );
+    REQUIRE( json_pointer_get(p, root, "/foo")->type == JSON_ARR );
+    json_jsontoken *baz = json_pointer_get(p, root, "/foo/1");
+    REQUIRE( baz != NULL );
+    REQUIRE( strncmp(doc + baz->start_in, "baz", 3) == 0 );
+    const char *pointers[] = {"/", "/a~1b", "/c%d", "/e^f", "/g|h", "/i\\j", "/k\"l", "/ ", "/m~0n"};
+    for (int i = 0; i < 9; i++) {
+        INFO( pointers[i] );
+        json_jsontoken *value = json_pointer_get(p, root, pointers[i]);
+        REQUIRE( value != NULL );
+        int64_t n;
+        REQUIRE( json_token_get_int64(p, value, &n) );
+        REQUIRE( n == i );
+    }
+    const char *missing[] = {"foo", "/~2", "/a~", "/foo/2", "/foo/-", "/foo/01", "/foo/+1",
+        "/nope", "/foo/0/x", "/c%d/0", "/foo/99999999999"};
+    for (int i = 0; i < 11; i++) {
+        INFO( missing[i] );
+        REQUIRE( json_pointer_get(p, root, missing[i]) == NULL );
+    }
+    REQUIRE( json_pointer_compile("/~2") == NULL );
+
+    /** A compiled pointer is reused across documents */
+    json_pointer *title = json_pointer_compile("/data/children/1/data/title");
+    REQUIRE( title != NULL );
+    REQUIRE( title->length == 5 );
+    REQUIRE( title->steps[2].index == 1 );
+    REQUIRE( title->steps[3].index == -1 );
+    const char *docs[] = {
+        "{\"data\": {\"children\": [{}, {\"data\": {\"title\": \"first\"}}]}}",
+        "{\"kind\": 1, \"data\": {\"after\": null, \"children\": [1, {\"data\": {\"x\": 0, \"title\": \"second\"}}]}}",
+        "{\"data\": {\"children\": [{\"data\": {\"title\": \"only one\"}}]}}"};
+    const char *titles[] = {"first", "second", NULL};
+    for (int i = 0; i < 3; i++) {
+        json_parser_reset(p, (char*) docs[i]);
+        REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+        json_jsontoken *value = json_pointer_resolve(p, p->all_tokens->tokens[1], title);
+        if (titles[i] == NULL) {
+            REQUIRE( value == NULL );
+        } else {
+            REQUIRE( value != NULL );
+            REQUIRE( strncmp(docs[i] + value->start_in, titles[i], strlen(titles[i])) == 0 );
+        }
+    }
+    json_pointer_release(title);
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_path_query", "[json_path]" )
+{
+    char *store = "{\"store\": {\"book\": ["
+        "{\"category\": \"reference\", \"author\": \"Nigel Rees\", \"title\": \"Sayings of the Century\", \"price\": 8.95},"
+        "{\"category\": \"fiction\", \"author\": \"Evelyn Waugh\", \"title\": \"Sword of Honour\", \"price\": 12.99},"
+        "{\"category\": \"fiction\", \"author\": \"Herman Melville\", \"title\": \"Moby Dick\", \"isbn\": \"0-553-21311-3\", \"price\": 8.99},"
+        "{\"category\": \"fiction\", \"author\": \"J. R. R. Tolkien\", \"title\": \"The Lord of the Rings\", \"isbn\": \"0-395-19395-8\", \"price\": 22.99}],"
+        "\"bicycle\": {\"color\": \"red\", \"price\": 19.95}}}";
+    json_parser *p = json_parser_create(store);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    json_jsontoken *root = p->all_tokens->tokens[1];
+
+    struct { const char *path; int count; const char *first; } cases[] = {
+        {"$", 1, "{"},
+        {"$.store.book[*].author", 4, "Nigel Rees"},
+        {"$..author", 4, "Nigel Rees"},
+        {"$.store.*", 2, "["},
+        {"$.store..price", 5, "8.95"},
+        {"$..book[2].title", 1, "Moby Dick"},
+        {"$..book[-1].author", 1, "J. R. R. Tolkien"},
+        {"$..book[0:2].price", 2, "8.95"},
+        {"$..book[:2].price", 2, "8.95"},
+        {"$..book[1:].price", 3, "12.99"},
+        {"$..book[::-1].price", 4, "22.99"},
+        {"$..book[-2::-2].price", 2, "8.99"},
+        {"$..book[::0]", 0, NULL},
+        {"$..book[7]", 0, NULL},
+        {"$..book[?(@.isbn)].title", 2, "Moby Dick"},
+        {"$..book[?(@.price < 10)].title", 2, "Sayings of the Century"},
+        {"$..book[?(@.price >= 12.99)].price", 2, "12.99"},
+        {"$..book[?(@.category == 'fiction')].title", 3, "Sword of Honour"},
+        {"$..book[?(@.category != \"fiction\")].title", 1, "Sayings of the Century"},
+        {"$..book[?(@.author > 'M')].author", 1, "Nigel Rees"},
+        {"$['store'][\"bicycle\"].color", 1, "red"},
+        {"$..[?(@.color == 'red')].price", 1, "19.95"},
+        {"$..*", 27, "{"},
+        {"$.store.missing[*]", 0, NULL},
+    };
+    json_jsontoken *out[32];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        INFO( cases[i].path );
+        json_path *path = json_path_compile(cases[i].path);
+        REQUIRE( path != NULL );
+        int count = json_path_query(p, root, path, out, 32);
+        REQUIRE( count == cases[i].count );
+        if (count > 0)
+            REQUIRE( strncmp(store + out[0]->start_in, cases[i].first, strlen(cases[i].first)) == 0 );
+        json_path_release(path);
+    }
+
+    /** Filters on literals, results past cap only counted */
+    char *flags = "[{\"on\": true, \"v\": null}, {\"on\": false, \"v\": 1}, {\"on\": true, \"v\": \"x\"}]";
+    json_parser_reset(p, flags);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == true );
+    root = p->all_tokens->tokens[1];
+    const char *paths[] = {"$[?(@.on == true)]", "$[?(@.on == false)]", "$[?(@.v == null)]",
+        "$[?(@.v != null)]", "$[?(@.v == 1)]", "$[?(@.v == '1')]"};
+    int counts[] = {2, 1, 1, 2, 1, 0};
+    for (int i = 0; i < 6; i++) {
+        INFO( paths[i] );
+        json_path *path = json_path_compile(paths[i]);
+        REQUIRE( path != NULL );
+        REQUIRE( json_path_query(p, root, path, out, 32) == counts[i] );
+        json_path_release(path);
+    }
+    json_path *all = json_path_compile("$..*");
+    out[1] = NULL;
+    REQUIRE( json_path_query(p, root, all, out, 1) == 9 );
+    REQUIRE( out[1] == NULL );
+    json_path_release(all);
+
+    const char *invalid[] = {"store", "$.", "$[", "$[?(@.a ~ 1)]", "$..", "$[1", "$['a]",
+        "$[?(@.a == 'x)]", "$[?(a)]", "$[?(@.a == 01)]", "$[]", "$x"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        INFO( invalid[i] );
+        REQUIRE( json_path_compile(invalid[i]) == NULL );
+    }
+    json_parser_cleanup(p);
+}
+
+/** Walks the pending value with a cursor, counting values and keys as the
+    tree parser counts tokens */
+static int
+cursor_count(json_cursor *cursor)
+{
+    json_jsontoken_type type = json_cursor_type(cursor);
+    if (type != JSON_OBJ && type != JSON_ARR) {
+        REQUIRE( json_cursor_skip(cursor) );
+        return 1;
+    }
+    int count = 1;
+    REQUIRE( json_cursor_enter(cursor) );
+    const char *key;
+    int length;
+    while (type == JSON_OBJ ? json_cursor_next_field(cursor, &key, &length) :
+        json_cursor_next_element(cursor))
+        count += cursor_count(cursor) + (type == JSON_OBJ);
+    REQUIRE( !cursor->error );
+    return count;
+}
+
+TEST_CASE( "json_cursor", "[json_cursor]" )
+{
+    const char *doc = "{\"id\": 42, \"skip\": {\"a\": [1, {\"b\": \"}\"}], \"c\": \"]\\\"[\"},"
+        " \"n\\u0061me\": \"caf\\u00e9\", \"tags\": [\"x\", \"y\"], \"score\": -1.5e2,"
+        " \"ok\": true, \"none\": null}";
+    json_cursor c;
+    int64_t i;
+    double d;
+    bool b;
+    char out[16];
+
+    /** Fields in document order, everything else skipped */
+    json_cursor_init(&c, doc, strlen(doc));
+    REQUIRE( json_cursor_type(&c) == JSON_OBJ );
+    REQUIRE( json_cursor_enter(&c) );
+    REQUIRE( json_cursor_find_field(&c, "id", 2) );
+    REQUIRE( json_cursor_type(&c) == JSON_INT );
+    REQUIRE( json_cursor_get_string(&c, out, sizeof(out)) == -1 );
+    REQUIRE( json_cursor_get_int64(&c, &i) );
+    REQUIRE( i == 42 );
+    REQUIRE( json_cursor_find_field(&c, "name", 4) );
+    REQUIRE( json_cursor_get_string(&c, out, 4) == 5 );
+    REQUIRE( json_cursor_get_string(&c, out, sizeof(out)) == 5 );
+    REQUIRE( strcmp(out, "caf\xc3\xa9") == 0 );
+    REQUIRE( json_cursor_find_field(&c, "score", 5) );
+    REQUIRE( json_cursor_type(&c) == JSON_FLO );
+    REQUIRE( json_cursor_get_double(&c, &d) );
+    REQUIRE( d == -150.0 );
+    REQUIRE( json_cursor_find_field(&c, "ok", 2) );
+    REQUIRE( json_cursor_get_null(&c) == false );
+    REQUIRE( json_cursor_get_bool(&c, &b) );
+    REQUIRE( b == true );
+    REQUIRE( json_cursor_find_field(&c, "none", 4) );
+    REQUIRE( json_cursor_get_null(&c) );
+    REQUIRE( json_cursor_find_field(&c, "id", 2) == false );
+    REQUIRE( c.depth == 0 );
+    REQUIRE( c.error == false );
+
+    /** Every key in turn, entering one array and leaving one object early */
+    json_cursor_init(&c, doc, strlen(doc));
+    REQUIRE( json_cursor_enter(&c) );
+    const char *key;
+    int length;
+    std::string keys;
+    while (json_cursor_next_field(&c, &key, &length)) {
+        keys += std::string(key, length) + " ";
+        if (std::string(key, length) == "skip") {
+            REQUIRE( json_cursor_enter(&c) );
+            REQUIRE( json_cursor_find_field(&c, "a", 1) );
+            REQUIRE( json_cursor_leave(&c) );
+        } else if (std::string(key, length) == "tags") {
+            REQUIRE( json_cursor_enter(&c) );
+            std::string tags;
+            int view;
+            while (json_cursor_next_element(&c)) {
+                const char *tag = json_cursor_get_string_view(&c, &view, out, sizeof(out));
+                tags += std::string(tag, view);
+            }
+            REQUIRE( tags == "xy" );
+        }
+    }
+    REQUIRE( keys == "id skip n\\u0061me tags score ok none " );
+    REQUIRE( c.depth == 0 );
+    REQUIRE( c.error == false );
+
+    /** Scalars at the root */
+    json_cursor_init(&c, " \"a\\nb\" ", 8);
+    int view;
+    const char *text = json_cursor_get_string_view(&c, &view, out, 2);
+    REQUIRE( text == NULL );
+    REQUIRE( view == 4 );
+    text = json_cursor_get_string_view(&c, &view, out, sizeof(out));
+    REQUIRE( std::string(text, view) == "a\nb" );
+    REQUIRE( json_cursor_type(&c) == JSON_OUT );
+    json_cursor_init(&c, "18446744073709551615", 20);
+    uint64_t u;
+    REQUIRE( json_cursor_get_int64(&c, &i) == false );
+    REQUIRE( json_cursor_get_uint64(&c, &u) );
+    REQUIRE( u == UINT64_MAX );
+
+    /** A NUL inside a string is malformed, whether read or skipped */
+    const char nul_string[] = {'[', '"', 'a', 0, '"', ']'};
+    json_cursor_init(&c, nul_string, 6);
+    REQUIRE( json_cursor_enter(&c) );
+    REQUIRE( json_cursor_next_element(&c) );
+    REQUIRE( json_cursor_get_string(&c, out, sizeof(out)) == -1 );
+    REQUIRE( c.error == true );
+    json_cursor_init(&c, nul_string, 6);
+    REQUIRE( json_cursor_enter(&c) );
+    REQUIRE( json_cursor_next_element(&c) );
+    REQUIRE( json_cursor_next_element(&c) == false );
+    REQUIRE( c.error == true );
+    const char nul_key[] = {'{', '"', 0, '"', ':', '1', '}'};
+    json_cursor_init(&c, nul_key, 7);
+    REQUIRE( json_cursor_enter(&c) );
+    REQUIRE( json_cursor_find_field(&c, "x", 1) == false );
+    REQUIRE( c.error == true );
+
+    /** Malformed input fails the cursor */
+    const char *invalid[] = {"{\"a\" 1}", "[1 2]", "[1,]", "{\"a\": 1,}", "[\"abc", "{\"a\": [1}",
+        "[1}", "{\"a\": {\"b\": \"]\"}", ""};
+    for (size_t k = 0; k < sizeof(invalid) / sizeof(invalid[0]); k++) {
+        INFO( invalid[k] );
+        json_cursor_init(&c, invalid[k], strlen(invalid[k]));
+        if (json_cursor_enter(&c))
+            while (json_cursor_next_field(&c, &key, &length) || json_cursor_next_element(&c)) {}
+        REQUIRE( c.error == true );
+    }
+
+    /** Walking random documents meets every value and key the tree parser makes */
+    unsigned int seed = 777;
+    for (int round = 0; round < 300; round++) {
+        std::string random;
+        random_value(random, seed, 6);
+        INFO( random );
+        json_parser *p = json_parser_create((char*) random.c_str());
+        REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+        json_cursor_init(&c, random.c_str(), random.size());
+        REQUIRE( cursor_count(&c) == p->all_tokens->length - 1 );
+        json_parser_cleanup(p);
+    }
+}
+
+TEST_CASE( "json_skip_value", "[json_skip_value]" )
+{
+    struct { const char *input; int end; } cases[] = {
+        {"  12, 3", 4}, {"-1.5e3]", 6}, {"\"a\\\"b\" x", 6}, {"true,", 4}, {"false", 5},
+        {"null}", 4}, {"{}", 2}, {"[[], {}] 1", 8}, {"{\"a\": \"}]\", \"b\": [\"[\\\"\"]} ]", 25},
+        {"", -1}, {"  ", -1}, {"[1, 2", -1}, {"{\"a\": \"}", -1}, {"\"abc", -1}, {"nul", -1},
+        {"fals", -1}, {"--1", -1}, {"}", -1}, {":", -1},
+    };
+    for (int k = JSON_KERNEL_SCALAR; k <= JSON_KERNEL_AVX512; k++) {
+        if (!json_kernel_supported((json_kernel) k))
+            continue;
+        INFO( "kernel: " << json_kernel_name((json_kernel) k) );
+        REQUIRE( json_kernel_select((json_kernel) k) );
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            INFO( cases[i].input );
+            REQUIRE( json_skip_value(cases[i].input, 0, strlen(cases[i].input)) == cases[i].end );
+        }
+        REQUIRE( json_skip_value("\"a\0b\" ", 0, 6) == -1 );
+        REQUIRE( json_skip_value("\"\\\0\" ", 0, 5) == -1 );
+
+        /** Brackets inside strings and escapes straddling 64-byte blocks */
+        for (int pad = 0; pad < 140; pad++) {
+            std::string doc = "{\"k\": [\"" + std::string(pad, 'a') + "\\\\\", \"\\\"]" +
+                std::string(pad % 67, ' ') + "\"], \"n\": [" + std::string(pad, '[') +
+                std::string(pad, ']') + "]} [";
+            INFO( doc );
+            REQUIRE( json_skip_value(doc.c_str(), 0, doc.size()) == (int) doc.size() - 2 );
+            REQUIRE( json_skip_value(doc.c_str(), 0, doc.size() - 3) == -1 );
+        }
+
+        /** Random documents end where the parser ends them */
+        unsigned int seed = 99;
+        for (int round = 0; round < 300; round++) {
+            std::string doc = " ";
+            random_value(doc, seed, 6);
+            json_parser *p = json_parser_create((char*) doc.c_str());
+            p->curr = json_skipws(p->input, 0, p->end);
+            REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+            REQUIRE( json_skip_value(doc.c_str(), 0, doc.size()) == p->curr );
+            json_parser_cleanup(p);
+        }
+    }
+    REQUIRE( json_kernel_select(JSON_KERNEL_AUTO) );
+}
+
+/** Skips the members named in the NULL-terminated list ctx */
+static bool
+skip_listed(void *ctx, const char *key, int length)
+{
+    for (const char **name = (const char**) ctx; *name != NULL; name++)
+        if ((int) strlen(*name) == length && memcmp(*name, key, length) == 0)
+            return true;
+    return false;
+}
+
+TEST_CASE( "json_parser_skip_keys", "[json_skip_value]" )
+{
+    const char *skipped[] = {"preview", "blob", NULL};
+    char *doc = (char*) "{\"id\": 7, \"preview\": {\"a\": [1, {\"b\": \"}\"}], \"c\": tru},"
+        " \"items\": [{\"blob\": [[[]]], \"n\": 1}], \"blob\": \"x\", \"name\": \"y\"}";
+    json_parser *p = json_parser_create(doc);
+    json_parser_enable_tape(p);
+    json_parser_skip_keys(p, skip_listed, skipped);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    json_jsontoken *root = p->all_tokens->tokens[1];
+    REQUIRE( root->children->length == 5 );
+    REQUIRE( json_obj_get(p, root, "preview", 7) == NULL );
+    REQUIRE( json_obj_get(p, root, "blob", 4) == NULL );
+    json_jsontoken *name = json_obj_get(p, root, "name", 4);
+    REQUIRE( name != NULL );
+    REQUIRE( doc[name->start_in] == 'y' );
+    REQUIRE( json_pointer_get(p, root, "/items/0/n") != NULL );
+    REQUIRE( json_pointer_get(p, root, "/items/0/blob") == NULL );
+    /** root, 5 keys, id, items, its object, 2 keys, n and name */
+    REQUIRE( p->all_tokens->length == 14 );
+    REQUIRE( p->tape->length == 14 );
+    REQUIRE( json_tape_next(&p->tape->entries[1]) == 14 );
+
+    /** The skipped value must still end */
+    json_parser_reset(p, (char*) "{\"preview\": [1, 2}");
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_parser_skip_keys(p, NULL, NULL);
+    json_parser_reset(p, doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_parser_cleanup(p);
+}
+
+TEST_CASE( "json_parser_project", "[json_projection]" )
+{
+    char *doc = (char*) "{\"id\": 1, \"user\": {\"n\\u0061me\": \"a\", \"email\": \"x\", \"tags\": [1, 2]},"
+        " \"events\": [{\"ts\": 10, \"kind\": \"k\", \"big\": {\"a\": [[{}]]}}, {\"ts\": 20, \"kind\": \"j\"}],"
+        " \"extra\": {\"deep\": [1, {\"ts\": \"]}\"}]}}";
+    const char *paths[] = {"/id", "/user/name", "/events/*/ts"};
+    json_projection *projection = json_projection_compile(paths, 3);
+    REQUIRE( projection != NULL );
+    json_parser *p = json_parser_create(doc);
+    json_parser_enable_tape(p);
+    json_parser_project(p, projection);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    json_jsontoken *root = p->all_tokens->tokens[1];
+    /** Wrapper, root, id, 1, user, its object, name, "a", events, its array, 2 x (object, ts, value) */
+    REQUIRE( p->all_tokens->length == 16 );
+    REQUIRE( p->tape->length == 16 );
+    int64_t value;
+    REQUIRE( json_token_get_int64(p, json_pointer_get(p, root, "/id"), &value) );
+    REQUIRE( value == 1 );
+    REQUIRE( json_token_get_int64(p, json_pointer_get(p, root, "/events/1/ts"), &value) );
+    REQUIRE( value == 20 );
+    REQUIRE( doc[json_pointer_get(p, root, "/user/name")->start_in] == 'a' );
+    REQUIRE( json_pointer_get(p, root, "/user/email") == NULL );
+    REQUIRE( json_pointer_get(p, root, "/events/0/kind") == NULL );
+    REQUIRE( json_pointer_get(p, root, "/extra") == NULL );
+
+    /** The projection stays in force across resets */
+    json_parser_reset(p, doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    REQUIRE( p->all_tokens->length == 16 );
+    json_projection_release(projection);
+
+    /** Named steps also take what the wildcard beside them takes; whole values are kept */
+    const char *merged[] = {"/events/*/ts", "/events/1/kind", "/user"};
+    projection = json_projection_compile(merged, 3);
+    json_parser_project(p, projection);
+    json_parser_reset(p, doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    root = p->all_tokens->tokens[1];
+    REQUIRE( json_pointer_get(p, root, "/events/0/kind") == NULL );
+    REQUIRE( doc[json_pointer_get(p, root, "/events/1/kind")->start_in] == 'j' );
+    REQUIRE( json_pointer_get(p, root, "/events/0/ts") != NULL );
+    REQUIRE( json_pointer_get(p, root, "/user/tags/1") != NULL );
+    json_projection_release(projection);
+
+    /** Skipped elements leave no token */
+    const char *second[] = {"/events/1/ts"};
+    projection = json_projection_compile(second, 1);
+    json_parser_project(p, projection);
+    json_parser_reset(p, doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    root = p->all_tokens->tokens[1];
+    REQUIRE( json_token_get_int64(p, json_pointer_get(p, root, "/events/0/ts"), &value) );
+    REQUIRE( value == 20 );
+
+    /** Skipped values must still end */
+    json_parser_reset(p, (char*) "{\"extra\": [1, \"2], \"events\": []}");
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_parser_reset(p, (char*) "{\"extra\" 1, \"events\": []}");
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    const char nul_key[] = {'{', '"', 'x', 0, '"', ':', '1', '}'};
+    json_parser_reset_n(p, nul_key, 8);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    json_projection_release(projection);
+    json_parser_project(p, NULL);
+    json_parser_reset(p, doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    REQUIRE( p->all_tokens->length == 40 );
+    json_parser_cleanup(p);
+
+    const char *invalid[] = {"/id", "user"};
+    REQUIRE( json_projection_compile(invalid, 2) == NULL );
+
+    /** Keeping the document, or everything under it, matches a full parse */
+    const char *whole[] = {""};
+    const char *members[] = {"/*"};
+    json_projection *keep_all = json_projection_compile(whole, 1);
+    json_projection *keep_members = json_projection_compile(members, 1);
+    unsigned int seed = 4242;
+    for (int round = 0; round < 300; round++) {
+        std::string random;
+        random_value(random, seed, 6);
+        INFO( random );
+        json_parser *full = json_parser_create((char*) random.c_str());
+        REQUIRE( json_parsevalue(full, full->all_tokens->tokens[0]) );
+        for (int k = 0; k < 2; k++) {
+            json_parser *projected = json_parser_create((char*) random.c_str());
+            json_parser_project(projected, k == 0 ? keep_all : keep_members);
+            REQUIRE( json_parsevalue(projected, projected->all_tokens->tokens[0]) );
+            REQUIRE( projected->curr == full->curr );
+            REQUIRE( projected->all_tokens->length == full->all_tokens->length );
+            json_parser_cleanup(projected);
+        }
+        json_parser_cleanup(full);
+    }
+    json_projection_release(keep_all);
+    json_projection_release(keep_members);
+}
+
+/** Expands every lazy container under token, depth first */
+static void
+expand_all(json_parser *p, json_jsontoken *token)
+{
+    REQUIRE( json_expand(p, token) );
+    for (int i = 0; i < token->children->length; i++)
+        expand_all(p, token->children->tokens[i]);
+}
+
+/** Requires the trees under a and b to have the same shape, types and spans */
+static void
+require_same_tree(json_jsontoken *a, json_jsontoken *b)
+{
+    REQUIRE( a->type == b->type );
+    REQUIRE( a->start_in == b->start_in );
+    REQUIRE( a->end_in == b->end_in );
+    REQUIRE( a->children->length == b->children->length );
+    for (int i = 0; i < a->children->length; i++)
+        require_same_tree(a->children->tokens[i], b->children->tokens[i]);
+}
+
+TEST_CASE( "json_expand", "[json_expand]" )
+{
+    char *doc = (char*) "{\"a\": 1, \"b\": {\"c\": [1, 2, {\"d\": \"}\"}], \"e\": {}},"
+        " \"f\": [[1], [2, [3]]], \"g\": \"s\"}";
+    json_parser *p = json_parser_create(doc);
+    json_parser_shallow(p, 1);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    json_jsontoken *root = p->all_tokens->tokens[1];
+    /** Wrapper, root, 4 keys and their values */
+    REQUIRE( p->all_tokens->length == 10 );
+    REQUIRE( json_token_is_lazy(p, root) == false );
+    json_jsontoken *b = json_obj_get(p, root, "b", 1);
+    REQUIRE( b->type == JSON_OBJ );
+    REQUIRE( json_token_is_lazy(p, b) );
+    REQUIRE( b->children->length == 0 );
+    REQUIRE( std::string(doc + b->start_in, b->end_in - b->start_in) ==
+        "{\"c\": [1, 2, {\"d\": \"}\"}], \"e\": {}}" );
+
+    /** Expanding goes one more level, counted from the token */
+    REQUIRE( json_expand(p, b) );
+    REQUIRE( json_token_is_lazy(p, b) == false );
+    REQUIRE( b->children->length == 2 );
+    json_jsontoken *c = json_obj_get(p, b, "c", 1);
+    REQUIRE( json_token_is_lazy(p, c) );
+    REQUIRE( json_expand(p, c) );
+    REQUIRE( c->children->length == 3 );
+    REQUIRE( json_token_is_lazy(p, c->children->tokens[2]) );
+    REQUIRE( json_expand(p, c) );
+    REQUIRE( c->children->length == 3 );
+    REQUIRE( json_pointer_get(p, root, "/b/c/2/d") == NULL );
+    REQUIRE( json_expand(p, c->children->tokens[2]) );
+    REQUIRE( doc[json_pointer_get(p, root, "/b/c/2/d")->start_in] == '}' );
+
+    /** Reset forgets the marks */
+    json_parser_shallow(p, 0);
+    json_parser_reset(p, doc);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    REQUIRE( p->all_tokens->length == 25 );
+    for (int i = 0; i < p->all_tokens->length; i++)
+        REQUIRE( json_token_is_lazy(p, p->all_tokens->tokens[i]) == false );
+
+    /** Spans are only matched by brackets until expanded */
+    json_parser_shallow(p, 1);
+    json_parser_reset(p, (char*) "{\"b\": {\"x\" 1}}");
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    b = p->all_tokens->tokens[1]->children->tokens[0]->children->tokens[0];
+    REQUIRE( json_expand(p, b) == false );
+    REQUIRE( b->error == true );
+    json_parser_reset(p, (char*) "{\"b\": [1, 2}");
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+
+    /** A failed expansion keeps the token lazy and childless, and fails again */
+    json_parser_reset(p, (char*) "{\"b\": [1, 2, {\"c\": 3}, tru]}");
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    int before = p->all_tokens->length;
+    b = p->all_tokens->tokens[1]->children->tokens[0]->children->tokens[0];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        REQUIRE( json_expand(p, b) == false );
+        REQUIRE( b->error == true );
+        REQUIRE( json_token_is_lazy(p, b) );
+        REQUIRE( b->children->length == 0 );
+        REQUIRE( p->all_tokens->length == before );
+    }
+    json_parser_cleanup(p);
+
+    /** Deferred spans are checked as UTF-8 when expanded, like a full parse */
+    char *bad = (char*) "{\"a\":{\"b\":[\"\xff\"]},\"c\":\"caf\xc3\xa9\"}";
+    p = json_parser_create(bad);
+    json_parser_enable_utf8(p);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) == false );
+    REQUIRE( p->utf8_error == 12 );
+    json_parser_shallow(p, 1);
+    json_parser_reset(p, bad);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    REQUIRE( p->utf8_error == -1 );
+    json_jsontoken *a = json_obj_get(p, p->all_tokens->tokens[1], "a", 1);
+    REQUIRE( json_expand(p, a) );
+    REQUIRE( json_expand(p, json_obj_get(p, a, "b", 1)) == false );
+    REQUIRE( p->utf8_error == 12 );
+    json_parser_cleanup(p);
+
+    p = json_parser_create(doc);
+    json_parser_enable_tape(p);
+    json_parser_shallow(p, 1);
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    REQUIRE( p->tape->length == 10 );
+    REQUIRE( json_expand(p, json_obj_get(p, p->all_tokens->tokens[1], "f", 1)) == false );
+    json_parser_cleanup(p);
+
+    /** Expanding everything at any depth gives the full parse */
+    unsigned int seed = 31337;
+    for (int round = 0; round < 300; round++) {
+        std::string random;
+        random_value(random, seed, 6);
+        INFO( random );
+        json_parser *full = json_parser_create_arena((char*) random.c_str());
+        REQUIRE( json_parsevalue(full, full->all_tokens->tokens[0]) );
+        json_parser *shallow = json_parser_create_arena((char*) random.c_str());
+        json_parser_shallow(shallow, 1 + round % 3);
+        REQUIRE( json_parsevalue(shallow, shallow->all_tokens->tokens[0]) );
+        REQUIRE( shallow->curr == full->curr );
+        REQUIRE( shallow->all_tokens->length <= full->all_tokens->length );
+        expand_all(shallow, shallow->all_tokens->tokens[1]);
+        REQUIRE( shallow->all_tokens->length == full->all_tokens->length );
+        require_same_tree(shallow->all_tokens->tokens[1], full->all_tokens->tokens[1]);
+        json_parser_cleanup(full);
+        json_parser_cleanup(shallow);
+    }
+}
+
+TEST_CASE( "json_parse_indexed_options", "[json_parse_indexed]" )
+{
+    char *doc = (char*) "{\"a\": [1, 2], \"b\": {\"c\": 3}}";
+    const char *paths[] = {"/a"};
+    const char *skipped[] = {"b", NULL};
+    json_projection *projection = json_projection_compile(paths, 1);
+    json_parser *p = json_parser_create(doc);
+    REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) );
+
+    /** Options only json_parsevalue implements make the indexed engine fail up front */
+    for (int option = 0; option < 3; option++) {
+        if (option == 0)
+            json_parser_skip_keys(p, skip_listed, skipped);
+        else if (option == 1)
+            json_parser_project(p, projection);
+        else
+            json_parser_shallow(p, 1);
+        json_parser_reset(p, doc);
+        json_jsontoken *outer = p->all_tokens->tokens[0];
+        REQUIRE( json_parse_indexed(p, outer) == false );
+        REQUIRE( outer->error );
+        REQUIRE( p->all_tokens->length == 1 );
+        json_parser_reset(p, doc);
+        REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+        json_parser_skip_keys(p, NULL, NULL);
+        json_parser_project(p, NULL);
+        json_parser_shallow(p, 0);
+    }
+    json_parser_reset(p, doc);
+    REQUIRE( json_parse_indexed(p, p->all_tokens->tokens[0]) );
+    json_parser_cleanup(p);
+    json_projection_release(projection);
+}
+
+TEST_CASE( "json_parser_presize_options", "[json_parser_presize]" )
+{
+    char *doc = (char*) "{\"a\": [1, 2], \"b\": {\"c\": [3, 4, 5]}}";
+    const char *paths[] = {"/a"};
+    const char *skipped[] = {"b", NULL};
+    json_projection *projection = json_projection_compile(paths, 1);
+    json_parser *p = json_parser_create(doc);
+
+    /** Options that skip tokens leave an upper bound and no per-index counts */
+    for (int option = 0; option < 3; option++) {
+        if (option == 0)
+            json_parser_skip_keys(p, skip_listed, skipped);
+        else if (option == 1)
+            json_parser_project(p, projection);
+        else
+            json_parser_shallow(p, 1);
+        json_parser_reset(p, doc);
+        REQUIRE( json_parser_presize(p) == true );
+        REQUIRE( p->child_counts == NULL );
+        REQUIRE( p->all_tokens->capacity >= 13 );
+        REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+        REQUIRE( p->all_tokens->length < 13 );
+        json_parser_skip_keys(p, NULL, NULL);
+        json_parser_project(p, NULL);
+        json_parser_shallow(p, 0);
+    }
+    json_parser_reset(p, doc);
+    REQUIRE( json_parser_presize(p) == true );
+    REQUIRE( p->child_counts_length == 13 );
+    REQUIRE( json_parsevalue(p, p->all_tokens->tokens[0]) );
+    REQUIRE( p->all_tokens->length == 13 );
+    json_parser_cleanup(p);
+    json_projection_release(projection);
+}